@@ -1,5 +1,5 @@
 #include "astprinter.h"
-#include "../utils/any_util.h"
+#include "../utils/value_util.h"
 #include <vector>
 
 std::string AstPrinter::print(const Expr &expr) {
@@ -8,7 +8,7 @@ std::string AstPrinter::print(const Expr &expr) {
   return s_.str();
 }
 
-void AstPrinter::parenthesize(const std::string &name,
+void AstPrinter::parenthesize(std::string_view name,
                               const std::vector<const Expr *> &exprs) {
   s_ << "(" << name;
   for (const auto &expr : exprs) {
@@ -19,31 +19,31 @@ void AstPrinter::parenthesize(const std::string &name,
 }
 
 ExprVisitorResT AstPrinter::visitBinaryExpr(const Binary &expr) {
-  std::vector<const Expr *> exprs = {expr.left.get(), expr.right.get()};
+  std::vector<const Expr *> exprs = {expr.left, expr.right};
   parenthesize(expr.op.lexeme, exprs);
   return ExprVisitorResT();
 }
 
 ExprVisitorResT AstPrinter::visitLogicalExpr(const Logical &expr) {
-  std::vector<const Expr *> exprs = {expr.left.get(), expr.right.get()};
+  std::vector<const Expr *> exprs = {expr.left, expr.right};
   parenthesize(expr.op.lexeme, exprs);
   return ExprVisitorResT();
 }
 
 ExprVisitorResT AstPrinter::visitGroupingExpr(const Grouping &expr) {
-  std::vector<const Expr *> exprs = {expr.expr.get()};
+  std::vector<const Expr *> exprs = {expr.expr};
   parenthesize("group", exprs);
   return ExprVisitorResT();
 }
 
 ExprVisitorResT AstPrinter::visitLiteralExpr(const Literal &expr) {
   auto &value = expr.value;
-  s_ << anyToStr(value);
+  s_ << valueToStr(value);
   return ExprVisitorResT();
 }
 
 ExprVisitorResT AstPrinter::visitUnaryExpr(const Unary &expr) {
-  std::vector<const Expr *> exprs = {expr.right.get()};
+  std::vector<const Expr *> exprs = {expr.right};
   parenthesize(expr.op.lexeme, exprs);
   return ExprVisitorResT();
 }
@@ -54,7 +54,7 @@ ExprVisitorResT AstPrinter::visitVariableExpr(const Variable &expr) {
 }
 
 ExprVisitorResT AstPrinter::visitAssignmentExpr(const Assignment &expr) {
-  std::vector<const Expr *> exprs = {expr.value.get()};
+  std::vector<const Expr *> exprs = {expr.value};
   parenthesize(expr.name.lexeme, exprs);
   return ExprVisitorResT();
 }
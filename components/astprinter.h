@@ -2,6 +2,7 @@
 
 #include "expr.h"
 #include <sstream>
+#include <string_view>
 
 class AstPrinter : public ExprVisitor {
 public:
@@ -15,7 +16,7 @@ public:
   std::string print(const Expr &expr);
 
 private:
-  void parenthesize(const std::string &name,
+  void parenthesize(std::string_view name,
                     const std::vector<const Expr *> &exprs);
   std::stringstream s_;
 };
@@ -0,0 +1,22 @@
+#pragma once
+
+// Where a resolved variable lives at runtime.
+// LOCAL: `slot` in the stack frame of the current call.
+// CAPTURED: `depth` environments up from the current one, at index `slot`.
+struct Location {
+  int depth;
+  int slot;
+};
+
+// Locals no closure refers to live in the call's stack frame; only the
+// ones some inner function captures need a heap Environment.
+enum class BindingType { GLOBAL, LOCAL, CAPTURED };
+
+// Resolution result stored on the nodes that declare or reference a
+// variable, filled in by the Resolver.
+// LOCAL and CAPTURED: `loc` as described above.
+// GLOBAL: `loc.slot` indexes the interpreter's GlobalTable.
+struct Binding {
+  BindingType type = BindingType::GLOBAL;
+  Location loc{0, 0};
+};
@@ -1,15 +1,21 @@
 #pragma once
 
-#include <any>
+#include "object.h"
+#include "value.h"
 #include <memory>
+#include <span>
 
 class Interpreter;
 
-class Callable {
+// Arguments of a call. They stay on the caller's stack (the Interpreter's
+// or the VM's), so passing them allocates nothing.
+using Args = std::span<const Value>;
+
+class Callable : public Object {
 public:
-  virtual std::any call(Interpreter &ip, const std::vector<std::any> &args) = 0;
+  explicit Callable(ObjType type) : Object(type) {}
+  virtual Value call(Interpreter &ip, Args args) = 0;
   virtual int arity() const = 0;
-  virtual ~Callable() = default;
 };
 
-using CallablePtr = std::shared_ptr<Callable>;
+using CallablePtr = Callable *;
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "loxstring.h"
+#include "shape.h"
+#include "token.h"
+#include "value.h"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+/**
+ * Bytecode for the VM. Operands follow their opcode inline; constant,
+ * global, property site and jump operands are 16 bits wide (high byte
+ * first), local, upvalue and argument count operands are 8 bits.
+ **/
+enum class OpCode : uint8_t {
+  CONSTANT,      // u16 constant
+  NIL,
+  TRUE,
+  FALSE,
+  POP,
+  GET_LOCAL,     // u8 stack slot
+  SET_LOCAL,     // u8 stack slot
+  GET_GLOBAL,    // u16 GlobalTable slot
+  DEFINE_GLOBAL, // u16 GlobalTable slot
+  SET_GLOBAL,    // u16 GlobalTable slot
+  GET_UPVALUE,   // u8 upvalue index
+  SET_UPVALUE,   // u8 upvalue index
+  GET_PROPERTY,  // u16 property site
+  SET_PROPERTY,  // u16 property site
+  GET_SUPER,     // u16 name constant
+  EQUAL,
+  NOT_EQUAL,
+  GREATER,
+  GREATER_EQUAL,
+  LESS,
+  LESS_EQUAL,
+  ADD,
+  SUBTRACT,
+  MULTIPLY,
+  DIVIDE,
+  NOT,
+  NEGATE,
+  PRINT,
+  JUMP,          // u16 forward offset
+  JUMP_IF_FALSE, // u16 forward offset, leaves the condition on the stack
+  LOOP,          // u16 backward offset
+  CALL,          // u8 argument count
+  INVOKE,        // u16 property site, u8 argument count
+  SUPER_INVOKE,  // u16 name constant, u8 argument count
+  // As above, but a closure callee replaces the calling frame. Always
+  // followed by RETURN, for callees that don't push a frame.
+  TAIL_CALL,         // u8 argument count
+  TAIL_INVOKE,       // u16 property site, u8 argument count
+  TAIL_SUPER_INVOKE, // u16 name constant, u8 argument count
+  CLOSURE,       // u16 function constant, then (u8 isLocal, u8 index) pairs
+  CLOSE_UPVALUE,
+  RETURN,
+  CLASS,         // u16 name constant
+  INHERIT,
+  METHOD,        // u16 name constant
+};
+
+class Chunk {
+public:
+  void write(uint8_t byte) { code.push_back(byte); }
+  void write(OpCode op) { write(static_cast<uint8_t>(op)); }
+  int addConstant(Value value) {
+    constants.push_back(std::move(value));
+    return constants.size() - 1;
+  }
+  int addProperty(const LoxString *name) {
+    properties.push_back(PropertySite{name, PropertyCache()});
+    return properties.size() - 1;
+  }
+  // Runtime errors in the code written from here on are reported against
+  // `token`, as the tree-walker reports them.
+  void markToken(const Token &token) {
+    tokens.push_back(TokenMark{static_cast<int>(code.size()), token});
+  }
+  // The token last marked at or before `offset`; there must be one.
+  const Token &tokenAt(int offset) const {
+    auto after = std::upper_bound(tokens.begin(), tokens.end(), offset,
+                                  [](int offset, const TokenMark &mark) {
+                                    return offset < mark.offset;
+                                  });
+    return std::prev(after)->token;
+  }
+
+  struct TokenMark {
+    int offset;
+    Token token;
+  };
+  // The property an instruction accesses, with that instruction's inline
+  // cache. Names are interned, so nothing needs to mark them.
+  struct PropertySite {
+    const LoxString *name;
+    PropertyCache cache;
+  };
+
+  std::vector<uint8_t> code;
+  // ordered by offset
+  std::vector<TokenMark> tokens;
+  std::vector<Value> constants;
+  std::vector<PropertySite> properties;
+};
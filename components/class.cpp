@@ -1,32 +1,46 @@
 #include "class.h"
+#include "gc.h"
 #include "instance.h"
 #include <memory>
 
-std::any LoxClass::call(Interpreter &ip, const std::vector<std::any> &args) {
-  auto instance = std::make_shared<LoxInstance>(this);
-  FunPtr initializer = findMethod("init");
-  if (initializer != nullptr) {
-    initializer->bind(instance)->call(ip, args);
+LoxClass::LoxClass(const std::string &name, ClassPtr super,
+                   SymbolMap<FunPtr> methods)
+    : Callable(ObjType::CLASS), name_(name), super_(super),
+      methods_(std::move(methods)), rootShape_(this) {
+  if (super_ != nullptr) {
+    // own methods override inherited ones, so insert() keeps them
+    methods_.insert(super_->methods_.begin(), super_->methods_.end());
   }
-  return instance;
+  initializer_ = findMethod(intern("init"));
 }
 
-FunPtr LoxClass::findMethod(const std::string &name) const {
-  if (methods_.find(name) != methods_.end()) {
-    return methods_.at(name);
+Value LoxClass::call(Interpreter &ip, Args args) {
+  auto instance = makeObj<LoxInstance>(this);
+  if (initializer_ != nullptr) {
+    TempRoots roots(instance);
+    initializer_->callMethod(ip, instance, args);
   }
+  return instance;
+}
 
-  if (super_ != nullptr) {
-    return super_->findMethod(name);
+FunPtr LoxClass::findMethod(const LoxString *name) const {
+  auto it = methods_.find(name);
+  if (it != methods_.end()) {
+    return it->second;
   }
-
   return nullptr;
 }
 
 int LoxClass::arity() const {
-  FunPtr initializer = findMethod("init");
-  if (initializer != nullptr) {
-    return initializer->arity();
+  if (initializer_ != nullptr) {
+    return initializer_->arity();
   }
   return 0;
 }
+
+void LoxClass::trace(GC &gc) const {
+  gc.mark(super_);
+  for (const auto &[name, method] : methods_) {
+    gc.mark(method);
+  }
+}
@@ -2,25 +2,33 @@
 
 #include "callable.h"
 #include "function.h"
+#include "loxstring.h"
+#include "shape.h"
 #include <string>
 #include <unordered_map>
 
 class LoxClass;
-using ClassPtr = std::shared_ptr<LoxClass>;
+using ClassPtr = LoxClass *;
 
 class LoxClass : public Callable {
 public:
-  LoxClass(const std::string &name, ClassPtr super,
-           std::unordered_map<std::string, FunPtr> methods)
-      : name_(name), super_(super), methods_(std::move(methods)) {}
-  std::string str() { return name_; }
-  std::any call(Interpreter &ip, const std::vector<std::any> &args);
-  int arity() const;
-  std::string name() { return name_; }
-  FunPtr findMethod(const std::string &name) const;
+  // methods are the class' own methods; inherited ones are copied in
+  LoxClass(const std::string &name, ClassPtr super, SymbolMap<FunPtr> methods);
+  std::string str() const override { return name_; }
+  void trace(GC &gc) const override;
+  Value call(Interpreter &ip, Args args) override;
+  int arity() const override;
+  std::string name() const { return name_; }
+  FunPtr findMethod(const LoxString *name) const;
+  // shape new instances start with
+  Shape *rootShape() { return &rootShape_; }
 
 private:
   const std::string name_;
   ClassPtr super_;
-  std::unordered_map<std::string, FunPtr> methods_;
+  // own and inherited methods, so lookup is one probe at any depth
+  SymbolMap<FunPtr> methods_;
+  // cached "init", nullptr if the class has none
+  FunPtr initializer_;
+  Shape rootShape_;
 };
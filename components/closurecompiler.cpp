@@ -0,0 +1,608 @@
+#include "closurecompiler.h"
+#include "../utils/value_util.h"
+#include "class.h"
+#include "function.h"
+#include "instance.h"
+#include "loxstring.h"
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+
+namespace {
+// Wraps a binary operator on two numbers into a closure that evaluates
+// both operands, checks them and applies op. Left and Right are the
+// operands' own closure types, so an operand that is a literal or a
+// local is read inline rather than through another ExprFn call.
+template <typename Left, typename Right, typename Op>
+ExprFn numeric(Left left, Right right, const Token &token, Op op) {
+  return [left = std::move(left), right = std::move(right), &token, op]() {
+    Value a = left();
+    Value b = right();
+    checkNumbers(token, a, b);
+    return Value(op(a.asNumber(), b.asNumber()));
+  };
+}
+} // namespace
+
+ClosureCompiler::ClosureCompiler(Interpreter &ip, ErrorReporter &errorReporter)
+    : ip_(ip), errorReporter_(errorReporter) {}
+
+template <typename Op>
+ExprFn ClosureCompiler::numeric(const Binary &expr, Op op) {
+  return withOperand(*expr.left, [&](auto left) {
+    return withOperand(*expr.right, [&](auto right) {
+      return ::numeric(std::move(left), std::move(right), expr.op, op);
+    });
+  });
+}
+
+template <typename K>
+auto ClosureCompiler::withOperand(const Expr &expr, K k) {
+  if (const auto *literal = dynamic_cast<const Literal *>(&expr)) {
+    return k([value = literal->value]() { return value; });
+  }
+  const auto *variable = dynamic_cast<const Variable *>(&expr);
+  if (variable != nullptr && variable->binding.type == BindingType::LOCAL) {
+    Interpreter &ip = ip_;
+    return k([&ip, slot = variable->binding.loc.slot]() {
+      return ip.frame()[slot];
+    });
+  }
+  return k(compile(expr));
+}
+
+template <typename K>
+auto ClosureCompiler::withCondition(const Expr &expr, K k) {
+  if (const auto *binary = dynamic_cast<const Binary *>(&expr)) {
+    switch (binary->op.type) {
+    case TokenType::GREATER:
+      return comparison(*binary, std::greater<double>(), k);
+    case TokenType::GREATER_EQUAL:
+      return comparison(*binary, std::greater_equal<double>(), k);
+    case TokenType::LESS:
+      return comparison(*binary, std::less<double>(), k);
+    case TokenType::LESS_EQUAL:
+      return comparison(*binary, std::less_equal<double>(), k);
+    default:
+      break;
+    }
+  }
+  return k([condition = compile(expr)]() { return isTruthy(condition()); });
+}
+
+template <typename Op, typename K>
+auto ClosureCompiler::comparison(const Binary &expr, Op op, K k) {
+  const Token &token = expr.op;
+  return withOperand(*expr.left, [&](auto left) {
+    return withOperand(*expr.right, [&](auto right) {
+      return k([left = std::move(left), right = std::move(right), &token,
+                op]() {
+        Value a = left();
+        Value b = right();
+        checkNumbers(token, a, b);
+        return op(a.asNumber(), b.asNumber());
+      });
+    });
+  });
+}
+
+ExprVisitorResT ClosureCompiler::visitBinaryExpr(const Binary &expr) {
+  const Token &op = expr.op;
+  switch (op.type) {
+  case TokenType::MINUS:
+    expr_ = numeric(expr, std::minus<double>());
+    return ExprVisitorResT();
+  case TokenType::SLASH:
+    expr_ = numeric(expr, std::divides<double>());
+    return ExprVisitorResT();
+  case TokenType::STAR:
+    expr_ = numeric(expr, std::multiplies<double>());
+    return ExprVisitorResT();
+  case TokenType::GREATER:
+    expr_ = numeric(expr, std::greater<double>());
+    return ExprVisitorResT();
+  case TokenType::GREATER_EQUAL:
+    expr_ = numeric(expr, std::greater_equal<double>());
+    return ExprVisitorResT();
+  case TokenType::LESS:
+    expr_ = numeric(expr, std::less<double>());
+    return ExprVisitorResT();
+  case TokenType::LESS_EQUAL:
+    expr_ = numeric(expr, std::less_equal<double>());
+    return ExprVisitorResT();
+  default:
+    break;
+  }
+
+  ExprFn left = compile(expr.left);
+  ExprFn right = compile(expr.right);
+  switch (op.type) {
+  case TokenType::PLUS:
+    expr_ = [left = std::move(left), right = std::move(right), &op]() {
+      Value a = left();
+      TempRoots roots(a);
+      Value b = right();
+      if (a.isNumber() && b.isNumber()) {
+        return Value(a.asNumber() + b.asNumber());
+      }
+      if (a.isString() && b.isString()) {
+        return Value(concatenate(a.as<LoxString>(), b.as<LoxString>()));
+      }
+      cannotAdd(op);
+    };
+    break;
+  case TokenType::BANG_EQUAL:
+    expr_ = [left = std::move(left), right = std::move(right)]() {
+      Value a = left();
+      TempRoots roots(a);
+      return Value(!valueEqual(a, right()));
+    };
+    break;
+  case TokenType::EQUAL_EQUAL:
+    expr_ = [left = std::move(left), right = std::move(right)]() {
+      Value a = left();
+      TempRoots roots(a);
+      return Value(valueEqual(a, right()));
+    };
+    break;
+  default:
+    expr_ = [left = std::move(left), right = std::move(right),
+             &op]() -> Value {
+      left();
+      right();
+      throw RuntimeError(op.errorStr() + ": unsupported binary operator");
+    };
+    break;
+  }
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT ClosureCompiler::visitGroupingExpr(const Grouping &expr) {
+  expr_ = compile(expr.expr);
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT ClosureCompiler::visitLiteralExpr(const Literal &expr) {
+  expr_ = [value = expr.value]() { return value; };
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT ClosureCompiler::visitUnaryExpr(const Unary &expr) {
+  ExprFn right = compile(expr.right);
+  const Token &op = expr.op;
+  switch (op.type) {
+  case TokenType::MINUS:
+    expr_ = [right = std::move(right), &op]() {
+      Value value = right();
+      checkNumber(op, value);
+      return Value(-value.asNumber());
+    };
+    break;
+  case TokenType::BANG:
+    expr_ = [right = std::move(right)]() { return Value(!isTruthy(right())); };
+    break;
+  default:
+    expr_ = [right = std::move(right), &op]() -> Value {
+      right();
+      throw RuntimeError(op.errorStr() + " unsupported unary operator");
+    };
+    break;
+  }
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT ClosureCompiler::visitVariableExpr(const Variable &expr) {
+  expr_ = lookUpVariable(expr.name, expr.binding);
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT ClosureCompiler::visitThisExpr(const This &expr) {
+  expr_ = lookUpVariable(expr.keyword, expr.binding);
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT ClosureCompiler::visitSuperExpr(const Super &expr) {
+  Interpreter &ip = ip_;
+  // "super" is only referred to from methods, so always captured
+  const Location loc = expr.binding.loc;
+  ExprFn object = lookUpVariable(expr.keyword, expr.thisBinding);
+  const Token &method = expr.method;
+  expr_ = [&ip, loc, object = std::move(object), &method]() {
+    const EnvPtr &env = ip.environment();
+    FunPtr fun = env->getAt(loc).as<LoxClass>()->findMethod(method.symbol());
+    if (fun == nullptr) {
+      undefinedSuperMethod(method);
+    }
+    return Value(fun->bind(object().as<LoxInstance>()));
+  };
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT ClosureCompiler::visitAssignmentExpr(const Assignment &expr) {
+  ExprFn value = compile(expr.value);
+  Interpreter &ip = ip_;
+  const Location loc = expr.binding.loc;
+  if (expr.binding.type == BindingType::LOCAL) {
+    expr_ = [&ip, slot = loc.slot, value = std::move(value)]() {
+      Value result = value();
+      ip.frame()[slot] = result;
+      return result;
+    };
+  } else if (expr.binding.type == BindingType::CAPTURED) {
+    expr_ = [&ip, loc, value = std::move(value)]() {
+      Value result = value();
+      ip.environment()->assignAt(loc, result);
+      return result;
+    };
+  } else {
+    GlobalTable &globals = ip_.globals();
+    const int slot = expr.binding.loc.slot;
+    const Token &name = expr.name;
+    expr_ = [&globals, slot, &name, value = std::move(value)]() {
+      Value result = value();
+      globals.assign(slot, name, result);
+      return result;
+    };
+  }
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT ClosureCompiler::visitLogicalExpr(const Logical &expr) {
+  ExprFn left = compile(expr.left);
+  ExprFn right = compile(expr.right);
+  if (expr.op.type == TokenType::OR) {
+    expr_ = [left = std::move(left), right = std::move(right)]() {
+      Value value = left();
+      return isTruthy(value) ? value : right();
+    };
+  } else {
+    expr_ = [left = std::move(left), right = std::move(right)]() {
+      Value value = left();
+      return !isTruthy(value) ? value : right();
+    };
+  }
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT ClosureCompiler::visitCallExpr(const Call &expr) {
+  expr_ = compileCall(expr, false);
+  return ExprVisitorResT();
+}
+
+// tail: record the call as the Interpreter's TailCall rather than making it
+ExprFn ClosureCompiler::compileCall(const Call &expr, bool tail) {
+  Interpreter &ip = ip_;
+  std::vector<ExprFn> arguments;
+  for (const auto &argument : expr.arguments) {
+    arguments.push_back(compile(argument));
+  }
+  const Token &paren = expr.paren;
+
+  if (expr.getCallee != nullptr) {
+    // obj.method(args): call the method with obj as its receiver instead
+    // of binding it to obj first
+    ExprFn object = compile(expr.getCallee->object);
+    const Token &name = expr.getCallee->name;
+    PropertyCache &cache = expr.getCallee->cache;
+    return [&ip, object = std::move(object), arguments = std::move(arguments),
+            &paren, &name, &cache, tail]() {
+      Value receiver = object();
+      if (!receiver.isInstance()) {
+        notAnInstance(name);
+      }
+      Value field;
+      LoxFunction *method =
+          receiver.as<LoxInstance>()->getForCall(name, cache, field);
+      TempRoots roots(receiver);
+      roots.add(field);
+
+      Interpreter::Arguments argStack(ip);
+      for (const auto &argument : arguments) {
+        argStack.push(argument());
+      }
+
+      Args args = argStack.args();
+      if (method == nullptr) {
+        Callable *fun = checkCallable(paren, field, args.size());
+        if (tail) {
+          ip.setTailCall(nullptr, Value(), fun, args);
+          return Value();
+        }
+        return fun->call(ip, args);
+      }
+      checkArity(paren, method->arity(), args.size());
+      if (tail) {
+        ip.setTailCall(method, receiver, nullptr, args);
+        return Value();
+      }
+      return method->callMethod(ip, receiver, args);
+    };
+  }
+
+  ExprFn callee = compile(expr.callee);
+  return [&ip, callee = std::move(callee), arguments = std::move(arguments),
+          &paren, tail]() {
+    Value value = callee();
+    TempRoots roots(value);
+
+    Interpreter::Arguments argStack(ip);
+    for (const auto &argument : arguments) {
+      argStack.push(argument());
+    }
+
+    Args args = argStack.args();
+    Callable *fun = checkCallable(paren, value, args.size());
+    if (tail) {
+      ip.setTailCall(nullptr, Value(), fun, args);
+      return Value();
+    }
+    return fun->call(ip, args);
+  };
+}
+
+ExprVisitorResT ClosureCompiler::visitGetExpr(const Get &expr) {
+  ExprFn object = compile(expr.object);
+  const Token &name = expr.name;
+  PropertyCache &cache = expr.cache;
+  expr_ = [object = std::move(object), &name, &cache]() {
+    Value value = object();
+    if (!value.isInstance()) {
+      notAnInstance(name);
+    }
+    return value.as<LoxInstance>()->get(name, cache);
+  };
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT ClosureCompiler::visitSetExpr(const Set &expr) {
+  ExprFn object = compile(expr.object);
+  ExprFn value = compile(expr.value);
+  const Token &name = expr.name;
+  PropertyCache &cache = expr.cache;
+  expr_ = [object = std::move(object), value = std::move(value), &name,
+           &cache]() {
+    Value instance = object();
+    if (!instance.isInstance()) {
+      notAnInstance(name);
+    }
+    TempRoots roots(instance);
+    instance.as<LoxInstance>()->set(name, value(), cache);
+    return Value();
+  };
+  return ExprVisitorResT();
+}
+
+StmtVisitorResT ClosureCompiler::visitPrintStmt(const PrintStmt &stmt) {
+  ExprFn expr = compile(stmt.expr);
+  stmt_ = [expr = std::move(expr)]() {
+    std::cout << valueToStr(expr()) << std::endl;
+    return Completion::NORMAL;
+  };
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT ClosureCompiler::visitReturnStmt(const ReturnStmt &stmt) {
+  Interpreter &ip = ip_;
+  if (stmt.tailCall) {
+    ExprFn call = compileCall(static_cast<const Call &>(*stmt.value), true);
+    stmt_ = [call = std::move(call)]() {
+      call();
+      return Completion::RETURN;
+    };
+    return StmtVisitorResT();
+  }
+  if (stmt.value == nullptr) {
+    stmt_ = [&ip]() {
+      ip.setReturnValue(Value());
+      return Completion::RETURN;
+    };
+    return StmtVisitorResT();
+  }
+  stmt_ = withOperand(*stmt.value, [&](auto value) -> StmtFn {
+    return [&ip, value = std::move(value)]() {
+      ip.setReturnValue(value());
+      return Completion::RETURN;
+    };
+  });
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT ClosureCompiler::visitExpressionStmt(
+    const ExpressionStmt &stmt) {
+  ExprFn expr = compile(stmt.expr);
+  stmt_ = [expr = std::move(expr)]() {
+    expr();
+    return Completion::NORMAL;
+  };
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT ClosureCompiler::visitVarDecl(const VarDecl &stmt) {
+  ExprFn value = stmt.initializer != nullptr
+                     ? compile(stmt.initializer)
+                     : [] { return Value(); };
+  stmt_ = declare(stmt.binding, value);
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT ClosureCompiler::visitBlock(const Block &block) {
+  Interpreter &ip = ip_;
+  StmtFn body = compileBlock(block.stmts);
+  if (!block.needsEnvironment) {
+    stmt_ = std::move(body);
+    return StmtVisitorResT();
+  }
+  stmt_ = [&ip, body = std::move(body)]() {
+    return ip.executeBlock(body,
+                           makeObj<Environment>(ip.environment()));
+  };
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT ClosureCompiler::visitIfStmt(const IfStmt &stmt) {
+  StmtFn thenStmt = compile(stmt.thenStmt);
+  StmtFn elseStmt = stmt.elseStmt != nullptr ? compile(stmt.elseStmt) : nullptr;
+  stmt_ = withCondition(*stmt.condition, [&](auto condition) -> StmtFn {
+    if (!elseStmt) {
+      return [condition = std::move(condition),
+              thenStmt = std::move(thenStmt)]() {
+        if (condition()) {
+          return thenStmt();
+        }
+        return Completion::NORMAL;
+      };
+    }
+    return [condition = std::move(condition), thenStmt = std::move(thenStmt),
+            elseStmt = std::move(elseStmt)]() {
+      return condition() ? thenStmt() : elseStmt();
+    };
+  });
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT ClosureCompiler::visitWhileStmt(const WhileStmt &stmt) {
+  StmtFn body = compile(stmt.stmt);
+  stmt_ = withCondition(*stmt.condition, [&](auto condition) -> StmtFn {
+    return [condition = std::move(condition), body = std::move(body)]() {
+      while (condition()) {
+        if (body() == Completion::RETURN) {
+          return Completion::RETURN;
+        }
+      }
+      return Completion::NORMAL;
+    };
+  });
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT ClosureCompiler::visitFunStmt(const FunStmt &stmt) {
+  Interpreter &ip = ip_;
+  // compiled once, shared by every closure created from this declaration
+  auto body = std::make_shared<const CompiledBody>(compileBlock(stmt.body));
+  stmt_ = declare(stmt.binding, [&ip, &stmt, body = std::move(body)]() {
+    return Value(makeObj<LoxFunction>(stmt, FunctionType::FUNCTION,
+                                      ip.environment(), body));
+  });
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT ClosureCompiler::visitClassStmt(const ClassStmt &stmt) {
+  Interpreter &ip = ip_;
+  ExprFn super = stmt.super != nullptr ? compile(*stmt.super) : nullptr;
+  std::vector<std::shared_ptr<const CompiledBody>> bodies;
+  for (const auto &method : stmt.methods) {
+    bodies.push_back(
+        std::make_shared<const CompiledBody>(compileBlock(method->body)));
+  }
+
+  auto klass = [&ip, &stmt, super = std::move(super),
+                bodies = std::move(bodies)]() {
+    ClassPtr superPtr = nullptr;
+    EnvPtr env = ip.environment();
+    TempRoots roots;
+    if (super) {
+      Value superClass = super();
+      if (!superClass.isClass()) {
+        notASuperclass(stmt.super->name);
+      }
+      superPtr = superClass.as<LoxClass>();
+      roots.add(superPtr);
+      env = makeObj<Environment>(env);
+      env->define(superPtr);
+      roots.add(env);
+    }
+
+    SymbolMap<FunPtr> methods;
+    for (size_t i = 0; i < stmt.methods.size(); i++) {
+      const FunStmt &method = *stmt.methods[i];
+      FunctionType type = method.name.lexeme == "init" ? FunctionType::INIT
+                                                       : FunctionType::METHOD;
+      FunPtr fun = makeObj<LoxFunction>(method, type, env, bodies[i]);
+      methods[method.name.symbol()] = fun;
+      roots.add(fun);
+    }
+    return Value(
+        makeObj<LoxClass>(std::string(stmt.name.lexeme), superPtr, std::move(methods)));
+  };
+  stmt_ = declare(stmt.binding, std::move(klass));
+  return StmtVisitorResT();
+}
+
+ExprFn ClosureCompiler::lookUpVariable(const Token &name,
+                                       const Binding &binding) {
+  Interpreter &ip = ip_;
+  const Location loc = binding.loc;
+  if (binding.type == BindingType::LOCAL) {
+    return [&ip, slot = loc.slot]() { return ip.frame()[slot]; };
+  }
+  if (binding.type == BindingType::CAPTURED) {
+    return [&ip, loc]() { return ip.environment()->getAt(loc); };
+  }
+  GlobalTable &globals = ip_.globals();
+  const int slot = binding.loc.slot;
+  return [&globals, slot, &name]() { return globals.get(slot, name); };
+}
+
+StmtFn ClosureCompiler::declare(const Binding &binding, ExprFn value) {
+  if (binding.type == BindingType::GLOBAL) {
+    GlobalTable &globals = ip_.globals();
+    const int slot = binding.loc.slot;
+    return [&globals, slot, value = std::move(value)]() {
+      globals.define(slot, value());
+      return Completion::NORMAL;
+    };
+  }
+  Interpreter &ip = ip_;
+  if (binding.type == BindingType::LOCAL) {
+    return [&ip, slot = binding.loc.slot, value = std::move(value)]() {
+      ip.frame()[slot] = value();
+      return Completion::NORMAL;
+    };
+  }
+  return [&ip, value = std::move(value)]() {
+    ip.environment()->define(value());
+    return Completion::NORMAL;
+  };
+}
+
+ExprFn ClosureCompiler::compile(const ExprPtr &expr) { return compile(*expr); }
+
+ExprFn ClosureCompiler::compile(const Expr &expr) {
+  expr.accept(*this);
+  return std::move(expr_);
+}
+
+StmtFn ClosureCompiler::compile(const StmtPtr &stmt) {
+  stmt->accept(*this);
+  return std::move(stmt_);
+}
+
+StmtFn ClosureCompiler::compileBlock(const std::vector<StmtPtr> &stmts) {
+  std::vector<StmtFn> fns;
+  for (const auto &stmt : stmts) {
+    fns.push_back(compile(stmt));
+  }
+  if (fns.size() == 1) {
+    return fns[0];
+  }
+  return [fns = std::move(fns)]() {
+    for (const auto &fn : fns) {
+      if (fn() == Completion::RETURN) {
+        return Completion::RETURN;
+      }
+    }
+    return Completion::NORMAL;
+  };
+}
+
+void ClosureCompiler::interpret(const std::vector<StmtPtr> &stmts,
+                                int frameSize) {
+  try {
+    Interpreter::Frame frame(ip_, frameSize);
+    for (const auto &stmt : stmts) {
+      compile(stmt)();
+    }
+  } catch (const RuntimeError &e) {
+    errorReporter_.reportRuntimeError(e);
+  }
+}
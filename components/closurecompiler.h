@@ -0,0 +1,77 @@
+#pragma once
+
+#include "error.h"
+#include "expr.h"
+#include "interpreter.h"
+#include "stmt.h"
+#include <functional>
+#include <vector>
+
+using ExprFn = std::function<Value()>;
+using StmtFn = CompiledBody;
+
+/**
+ * Closure-compilation engine, an alternative execution mode to walking
+ * the AST with the Interpreter.
+ *
+ * Every node is compiled once into a C++ closure that already knows its
+ * operator, resolved variable location and child closures, so running
+ * the program involves neither visitor dispatch nor per-node switches.
+ * The closures share the Interpreter's runtime state (stack frames,
+ * environments, globals, functions, classes), and reuse the Resolver's
+ * bindings.
+ **/
+class ClosureCompiler : public ExprVisitor, public StmtVisitor {
+public:
+  ClosureCompiler(Interpreter &ip, ErrorReporter &errorReporter);
+  ExprVisitorResT visitBinaryExpr(const Binary &expr) override;
+  ExprVisitorResT visitGroupingExpr(const Grouping &expr) override;
+  ExprVisitorResT visitLiteralExpr(const Literal &expr) override;
+  ExprVisitorResT visitUnaryExpr(const Unary &expr) override;
+  ExprVisitorResT visitVariableExpr(const Variable &expr) override;
+  ExprVisitorResT visitAssignmentExpr(const Assignment &expr) override;
+  ExprVisitorResT visitLogicalExpr(const Logical &expr) override;
+  ExprVisitorResT visitCallExpr(const Call &expr) override;
+  ExprVisitorResT visitGetExpr(const Get &expr) override;
+  ExprVisitorResT visitSetExpr(const Set &expr) override;
+  ExprVisitorResT visitThisExpr(const This &expr) override;
+  ExprVisitorResT visitSuperExpr(const Super &expr) override;
+  StmtVisitorResT visitPrintStmt(const PrintStmt &stmt) override;
+  StmtVisitorResT visitExpressionStmt(const ExpressionStmt &stmt) override;
+  StmtVisitorResT visitVarDecl(const VarDecl &stmt) override;
+  StmtVisitorResT visitBlock(const Block &block) override;
+  StmtVisitorResT visitIfStmt(const IfStmt &stmt) override;
+  StmtVisitorResT visitWhileStmt(const WhileStmt &stmt) override;
+  StmtVisitorResT visitFunStmt(const FunStmt &stmt) override;
+  StmtVisitorResT visitReturnStmt(const ReturnStmt &stmt) override;
+  StmtVisitorResT visitClassStmt(const ClassStmt &stmt) override;
+  // Compiles and runs a resolved program. The closures keep referring to
+  // the AST, which must outlive any function the program defines.
+  // frameSize: the Resolver's scriptFrameSize() for stmts
+  void interpret(const std::vector<StmtPtr> &stmts, int frameSize);
+
+private:
+  ExprFn compile(const ExprPtr &expr);
+  ExprFn compile(const Expr &expr);
+  StmtFn compile(const StmtPtr &stmt);
+  StmtFn compileBlock(const std::vector<StmtPtr> &stmts);
+  ExprFn compileCall(const Call &expr, bool tail);
+  ExprFn lookUpVariable(const Token &name, const Binding &binding);
+  // the numeric operator op applied to expr's operands
+  template <typename Op> ExprFn numeric(const Binary &expr, Op op);
+  // Calls k with a closure evaluating expr: a literal or a local is read
+  // by a closure of its own type, anything else through an ExprFn.
+  template <typename K> auto withOperand(const Expr &expr, K k);
+  // Calls k with a closure testing whether expr is truthy; a numeric
+  // comparison is tested without boxing its result into a Value.
+  template <typename K> auto withCondition(const Expr &expr, K k);
+  template <typename Op, typename K>
+  auto comparison(const Binary &expr, Op op, K k);
+  StmtFn declare(const Binding &binding, ExprFn value);
+
+  Interpreter &ip_;
+  ErrorReporter &errorReporter_;
+  // result of the last visited node
+  ExprFn expr_;
+  StmtFn stmt_;
+};
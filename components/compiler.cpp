@@ -0,0 +1,599 @@
+#include "compiler.h"
+#include "loxstring.h"
+
+namespace {
+const int MAX_LOCALS = 256;
+const int MAX_UPVALUES = 256;
+const int MAX_SHORT = 0xffff;
+} // namespace
+
+Compiler::Compiler(ErrorReporter &errorReporter)
+    : errorReporter_(errorReporter), current_(nullptr), line_(1),
+      hadError_(false) {}
+
+VmFunctionPtr Compiler::compile(const std::vector<StmtPtr> &stmts) {
+  FunctionState script{nullptr, makeObj<VmFunction>(""), FunctionType::NONE,
+                       {}, {}, 0};
+  // slot 0 holds the function being run
+  script.locals.push_back(Local{"", 0, false});
+  current_ = &script;
+  hadError_ = false;
+
+  for (const auto &stmt : stmts) {
+    compile(stmt);
+  }
+  emitReturn();
+
+  current_ = nullptr;
+  if (hadError_) {
+    return nullptr;
+  }
+  return script.function;
+}
+
+void Compiler::compile(const StmtPtr &stmt) { stmt->accept(*this); }
+
+void Compiler::compile(const ExprPtr &expr) { expr->accept(*this); }
+
+ExprVisitorResT Compiler::visitBinaryExpr(const Binary &expr) {
+  compile(expr.left);
+  compile(expr.right);
+  line_ = expr.op.line;
+  chunk().markToken(expr.op);
+  switch (expr.op.type) {
+  case TokenType::MINUS:
+    emit(OpCode::SUBTRACT);
+    break;
+  case TokenType::SLASH:
+    emit(OpCode::DIVIDE);
+    break;
+  case TokenType::STAR:
+    emit(OpCode::MULTIPLY);
+    break;
+  case TokenType::PLUS:
+    emit(OpCode::ADD);
+    break;
+  case TokenType::GREATER:
+    emit(OpCode::GREATER);
+    break;
+  case TokenType::GREATER_EQUAL:
+    emit(OpCode::GREATER_EQUAL);
+    break;
+  case TokenType::LESS:
+    emit(OpCode::LESS);
+    break;
+  case TokenType::LESS_EQUAL:
+    emit(OpCode::LESS_EQUAL);
+    break;
+  case TokenType::BANG_EQUAL:
+    emit(OpCode::NOT_EQUAL);
+    break;
+  case TokenType::EQUAL_EQUAL:
+    emit(OpCode::EQUAL);
+    break;
+  default:
+    error("Unsupported binary operator '" + std::string(expr.op.lexeme) + "'.");
+    break;
+  }
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Compiler::visitGroupingExpr(const Grouping &expr) {
+  compile(expr.expr);
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Compiler::visitLiteralExpr(const Literal &expr) {
+  const Value &value = expr.value;
+  if (value.isNil()) {
+    emit(OpCode::NIL);
+  } else if (value.isBool()) {
+    emit(value.asBool() ? OpCode::TRUE : OpCode::FALSE);
+  } else {
+    emitConstant(value);
+  }
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Compiler::visitUnaryExpr(const Unary &expr) {
+  compile(expr.right);
+  line_ = expr.op.line;
+  chunk().markToken(expr.op);
+  switch (expr.op.type) {
+  case TokenType::MINUS:
+    emit(OpCode::NEGATE);
+    break;
+  case TokenType::BANG:
+    emit(OpCode::NOT);
+    break;
+  default:
+    error("Unsupported unary operator '" + std::string(expr.op.lexeme) + "'.");
+    break;
+  }
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Compiler::visitVariableExpr(const Variable &expr) {
+  getVariable(expr.binding, expr.name);
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Compiler::visitAssignmentExpr(const Assignment &expr) {
+  compile(expr.value);
+  setVariable(expr.binding, expr.name);
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Compiler::visitLogicalExpr(const Logical &expr) {
+  compile(expr.left);
+  line_ = expr.op.line;
+  if (expr.op.type == TokenType::OR) {
+    int elseJump = emitJump(OpCode::JUMP_IF_FALSE);
+    int endJump = emitJump(OpCode::JUMP);
+    patchJump(elseJump);
+    emit(OpCode::POP);
+    compile(expr.right);
+    patchJump(endJump);
+  } else {
+    int endJump = emitJump(OpCode::JUMP_IF_FALSE);
+    emit(OpCode::POP);
+    compile(expr.right);
+    patchJump(endJump);
+  }
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Compiler::visitCallExpr(const Call &expr) {
+  call(expr, false);
+  return ExprVisitorResT();
+}
+
+// tail: the callee takes over the current frame (see ReturnStmt::tailCall)
+void Compiler::call(const Call &expr, bool tail) {
+  // `obj.name(...)` and `super.name(...)` are invoked directly, without
+  // creating a bound method first.
+  if (const Get *get = dynamic_cast<const Get *>(expr.callee)) {
+    compile(get->object);
+    for (const auto &arg : expr.arguments) {
+      compile(arg);
+    }
+    line_ = expr.paren.line;
+    int site = propertySite(get->name);
+    chunk().markToken(get->name);
+    emit(tail ? OpCode::TAIL_INVOKE : OpCode::INVOKE);
+    emitShort(site);
+    chunk().markToken(expr.paren);
+    emit(static_cast<uint8_t>(expr.arguments.size()));
+    return;
+  }
+  if (const Super *super = dynamic_cast<const Super *>(expr.callee)) {
+    line_ = super->keyword.line;
+    getLocalOrUpvalue("this", line_);
+    for (const auto &arg : expr.arguments) {
+      compile(arg);
+    }
+    getLocalOrUpvalue("super", line_);
+    line_ = expr.paren.line;
+    int name = nameConstant(super->method);
+    chunk().markToken(super->method);
+    emit(tail ? OpCode::TAIL_SUPER_INVOKE : OpCode::SUPER_INVOKE);
+    emitShort(name);
+    chunk().markToken(expr.paren);
+    emit(static_cast<uint8_t>(expr.arguments.size()));
+    return;
+  }
+
+  compile(expr.callee);
+  for (const auto &arg : expr.arguments) {
+    compile(arg);
+  }
+  line_ = expr.paren.line;
+  chunk().markToken(expr.paren);
+  emit(tail ? OpCode::TAIL_CALL : OpCode::CALL);
+  emit(static_cast<uint8_t>(expr.arguments.size()));
+}
+
+ExprVisitorResT Compiler::visitGetExpr(const Get &expr) {
+  compile(expr.object);
+  line_ = expr.name.line;
+  int site = propertySite(expr.name);
+  chunk().markToken(expr.name);
+  emit(OpCode::GET_PROPERTY);
+  emitShort(site);
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Compiler::visitSetExpr(const Set &expr) {
+  compile(expr.object);
+  compile(expr.value);
+  line_ = expr.name.line;
+  int site = propertySite(expr.name);
+  chunk().markToken(expr.name);
+  emit(OpCode::SET_PROPERTY);
+  emitShort(site);
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Compiler::visitThisExpr(const This &expr) {
+  getLocalOrUpvalue("this", expr.keyword.line);
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Compiler::visitSuperExpr(const Super &expr) {
+  line_ = expr.keyword.line;
+  getLocalOrUpvalue("this", line_);
+  getLocalOrUpvalue("super", line_);
+  int name = nameConstant(expr.method);
+  chunk().markToken(expr.method);
+  emit(OpCode::GET_SUPER);
+  emitShort(name);
+  return ExprVisitorResT();
+}
+
+StmtVisitorResT Compiler::visitPrintStmt(const PrintStmt &stmt) {
+  compile(stmt.expr);
+  emit(OpCode::PRINT);
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Compiler::visitExpressionStmt(const ExpressionStmt &stmt) {
+  compile(stmt.expr);
+  emit(OpCode::POP);
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Compiler::visitVarDecl(const VarDecl &stmt) {
+  line_ = stmt.name.line;
+  if (stmt.binding.type != BindingType::GLOBAL) {
+    declareLocal(stmt.name.lexeme, stmt.name.line);
+  }
+  if (stmt.initializer != nullptr) {
+    compile(stmt.initializer);
+  } else {
+    emit(OpCode::NIL);
+  }
+  defineVariable(stmt.binding);
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Compiler::visitBlock(const Block &block) {
+  beginScope();
+  for (const auto &stmt : block.stmts) {
+    compile(stmt);
+  }
+  endScope();
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Compiler::visitIfStmt(const IfStmt &stmt) {
+  compile(stmt.condition);
+  int thenJump = emitJump(OpCode::JUMP_IF_FALSE);
+  emit(OpCode::POP);
+  compile(stmt.thenStmt);
+  int elseJump = emitJump(OpCode::JUMP);
+  patchJump(thenJump);
+  emit(OpCode::POP);
+  if (stmt.elseStmt != nullptr) {
+    compile(stmt.elseStmt);
+  }
+  patchJump(elseJump);
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Compiler::visitWhileStmt(const WhileStmt &stmt) {
+  int loopStart = chunk().code.size();
+  compile(stmt.condition);
+  int exitJump = emitJump(OpCode::JUMP_IF_FALSE);
+  emit(OpCode::POP);
+  compile(stmt.stmt);
+  emitLoop(loopStart);
+  patchJump(exitJump);
+  emit(OpCode::POP);
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Compiler::visitFunStmt(const FunStmt &stmt) {
+  line_ = stmt.name.line;
+  if (stmt.binding.type != BindingType::GLOBAL) {
+    declareLocal(stmt.name.lexeme, stmt.name.line);
+    // a function may refer to itself
+    markInitialized();
+  }
+  function(stmt, FunctionType::FUNCTION);
+  defineVariable(stmt.binding);
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Compiler::visitReturnStmt(const ReturnStmt &stmt) {
+  line_ = stmt.keyword.line;
+  if (current_->type == FunctionType::INIT) {
+    // the Resolver already rejected initializers returning a value
+    emitReturn();
+    return StmtVisitorResT();
+  }
+  if (stmt.tailCall) {
+    // still returns the result when the callee isn't a closure
+    call(static_cast<const Call &>(*stmt.value), true);
+  } else if (stmt.value != nullptr) {
+    compile(stmt.value);
+  } else {
+    emit(OpCode::NIL);
+  }
+  emit(OpCode::RETURN);
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Compiler::visitClassStmt(const ClassStmt &stmt) {
+  line_ = stmt.name.line;
+  int name = nameConstant(stmt.name);
+  if (stmt.binding.type != BindingType::GLOBAL) {
+    declareLocal(stmt.name.lexeme, stmt.name.line);
+  }
+  emit(OpCode::CLASS);
+  emitShort(name);
+  defineVariable(stmt.binding);
+
+  // "super" is a local of a scope wrapping the methods, so they capture it
+  // as an upvalue.
+  if (stmt.super != nullptr) {
+    compile(*stmt.super);
+    beginScope();
+    declareLocal("super", stmt.super->name.line);
+    markInitialized();
+    getVariable(stmt.binding, stmt.name);
+    chunk().markToken(stmt.super->name);
+    emit(OpCode::INHERIT);
+  }
+
+  getVariable(stmt.binding, stmt.name);
+  for (const auto &method : stmt.methods) {
+    line_ = method->name.line;
+    int methodName = nameConstant(method->name);
+    function(*method, method->name.lexeme == "init" ? FunctionType::INIT
+                                                    : FunctionType::METHOD);
+    emit(OpCode::METHOD);
+    emitShort(methodName);
+  }
+  emit(OpCode::POP);
+
+  if (stmt.super != nullptr) {
+    endScope();
+  }
+  return StmtVisitorResT();
+}
+
+void Compiler::compile(const Expr &expr) { expr.accept(*this); }
+
+void Compiler::function(const FunStmt &fun, FunctionType type) {
+  FunctionState state{current_, makeObj<VmFunction>(std::string(fun.name.lexeme)), type,
+                      {}, {}, 0};
+  state.function->arity = fun.params.size();
+  // slot 0 holds the receiver in methods and the callee otherwise
+  bool hasReceiver = type == FunctionType::METHOD || type == FunctionType::INIT;
+  state.locals.push_back(Local{hasReceiver ? "this" : "", 0, false});
+  current_ = &state;
+
+  beginScope();
+  for (const auto &param : fun.params) {
+    declareLocal(param.lexeme, param.line);
+    markInitialized();
+  }
+  for (const auto &stmt : fun.body) {
+    compile(stmt);
+  }
+  emitReturn();
+  current_ = state.enclosing;
+
+  state.function->upvalueCount = state.upvalues.size();
+  emit(OpCode::CLOSURE);
+  emitShort(makeConstant(state.function));
+  for (const auto &upvalue : state.upvalues) {
+    emit(static_cast<uint8_t>(upvalue.isLocal ? 1 : 0));
+    emit(upvalue.index);
+  }
+}
+
+void Compiler::beginScope() { current_->scopeDepth++; }
+
+void Compiler::endScope() {
+  current_->scopeDepth--;
+  auto &locals = current_->locals;
+  while (!locals.empty() && locals.back().depth > current_->scopeDepth) {
+    emit(locals.back().isCaptured ? OpCode::CLOSE_UPVALUE : OpCode::POP);
+    locals.pop_back();
+  }
+}
+
+void Compiler::declareLocal(std::string_view name, int line) {
+  line_ = line;
+  if (current_->locals.size() >= MAX_LOCALS) {
+    error("Too many local variables in function.");
+    return;
+  }
+  current_->locals.push_back(Local{name, -1, false});
+}
+
+void Compiler::markInitialized() {
+  if (current_->scopeDepth == 0 || current_->locals.empty())
+    return;
+  current_->locals.back().depth = current_->scopeDepth;
+}
+
+void Compiler::defineVariable(const Binding &binding) {
+  if (binding.type != BindingType::GLOBAL) {
+    // the value just stays on the stack, in the local's slot
+    markInitialized();
+    return;
+  }
+  emit(OpCode::DEFINE_GLOBAL);
+  emitShort(binding.loc.slot);
+}
+
+int Compiler::resolveLocal(FunctionState *state, std::string_view name) {
+  for (int i = state->locals.size() - 1; i >= 0; i--) {
+    if (state->locals[i].name == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int Compiler::resolveUpvalue(FunctionState *state, std::string_view name) {
+  if (state->enclosing == nullptr)
+    return -1;
+
+  int local = resolveLocal(state->enclosing, name);
+  if (local != -1) {
+    state->enclosing->locals[local].isCaptured = true;
+    return addUpvalue(state, static_cast<uint8_t>(local), true);
+  }
+
+  int upvalue = resolveUpvalue(state->enclosing, name);
+  if (upvalue != -1) {
+    return addUpvalue(state, static_cast<uint8_t>(upvalue), false);
+  }
+  return -1;
+}
+
+int Compiler::addUpvalue(FunctionState *state, uint8_t index, bool isLocal) {
+  auto &upvalues = state->upvalues;
+  for (size_t i = 0; i < upvalues.size(); i++) {
+    if (upvalues[i].index == index && upvalues[i].isLocal == isLocal) {
+      return i;
+    }
+  }
+  if (upvalues.size() >= MAX_UPVALUES) {
+    error("Too many closure variables in function.");
+    return 0;
+  }
+  upvalues.push_back(UpvalueRef{index, isLocal});
+  return upvalues.size() - 1;
+}
+
+void Compiler::getVariable(const Binding &binding, const Token &name) {
+  line_ = name.line;
+  if (binding.type == BindingType::GLOBAL) {
+    chunk().markToken(name);
+    emit(OpCode::GET_GLOBAL);
+    emitShort(binding.loc.slot);
+    return;
+  }
+  getLocalOrUpvalue(name.lexeme, name.line);
+}
+
+void Compiler::getLocalOrUpvalue(std::string_view name, int line) {
+  line_ = line;
+  int arg = resolveLocal(current_, name);
+  if (arg != -1) {
+    emit(OpCode::GET_LOCAL);
+    emit(static_cast<uint8_t>(arg));
+    return;
+  }
+  arg = resolveUpvalue(current_, name);
+  if (arg != -1) {
+    emit(OpCode::GET_UPVALUE);
+    emit(static_cast<uint8_t>(arg));
+    return;
+  }
+  error("Cannot resolve '" + std::string(name) + "'.");
+}
+
+void Compiler::setVariable(const Binding &binding, const Token &name) {
+  line_ = name.line;
+  if (binding.type == BindingType::GLOBAL) {
+    chunk().markToken(name);
+    emit(OpCode::SET_GLOBAL);
+    emitShort(binding.loc.slot);
+    return;
+  }
+  int arg = resolveLocal(current_, name.lexeme);
+  if (arg != -1) {
+    emit(OpCode::SET_LOCAL);
+    emit(static_cast<uint8_t>(arg));
+    return;
+  }
+  arg = resolveUpvalue(current_, name.lexeme);
+  if (arg != -1) {
+    emit(OpCode::SET_UPVALUE);
+    emit(static_cast<uint8_t>(arg));
+    return;
+  }
+  error("Cannot resolve '" + std::string(name.lexeme) + "'.");
+}
+
+void Compiler::emitShort(int value) {
+  if (value > MAX_SHORT) {
+    error("Operand too large.");
+  }
+  emit(static_cast<uint8_t>((value >> 8) & 0xff));
+  emit(static_cast<uint8_t>(value & 0xff));
+}
+
+void Compiler::emitConstant(const Value &value) {
+  emit(OpCode::CONSTANT);
+  emitShort(makeConstant(value));
+}
+
+int Compiler::makeConstant(const Value &value) {
+  int constant = chunk().addConstant(value);
+  if (constant > MAX_SHORT) {
+    error("Too many constants in one chunk.");
+    return 0;
+  }
+  return constant;
+}
+
+int Compiler::nameConstant(const Token &name) {
+  return makeConstant(name.symbol());
+}
+
+int Compiler::propertySite(const Token &name) {
+  int site = chunk().addProperty(name.symbol());
+  if (site > MAX_SHORT) {
+    error("Too many property accesses in one chunk.");
+    return 0;
+  }
+  return site;
+}
+
+int Compiler::emitJump(OpCode op) {
+  emit(op);
+  emit(0xff);
+  emit(0xff);
+  return chunk().code.size() - 2;
+}
+
+void Compiler::patchJump(int offset) {
+  // -2 to adjust for the jump offset itself
+  int jump = chunk().code.size() - offset - 2;
+  if (jump > MAX_SHORT) {
+    error("Too much code to jump over.");
+  }
+  chunk().code[offset] = (jump >> 8) & 0xff;
+  chunk().code[offset + 1] = jump & 0xff;
+}
+
+void Compiler::emitLoop(int loopStart) {
+  emit(OpCode::LOOP);
+  // +2 to skip over the LOOP operand itself
+  int offset = chunk().code.size() - loopStart + 2;
+  if (offset > MAX_SHORT) {
+    error("Loop body too large.");
+  }
+  emitShort(offset);
+}
+
+void Compiler::emitReturn() {
+  if (current_->type == FunctionType::INIT) {
+    emit(OpCode::GET_LOCAL);
+    emit(0);
+  } else {
+    emit(OpCode::NIL);
+  }
+  emit(OpCode::RETURN);
+}
+
+void Compiler::error(const std::string &msg) {
+  errorReporter_.report(line_, msg);
+  hadError_ = true;
+}
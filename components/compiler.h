@@ -0,0 +1,109 @@
+#pragma once
+
+#include "chunk.h"
+#include "error.h"
+#include "expr.h"
+#include "resolver.h"
+#include "stmt.h"
+#include "vmobject.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Compiles a resolved program to bytecode for the VM.
+ *
+ * Globals use the GlobalTable slots the Resolver already stored on the
+ * AST. Locals live on the VM stack instead of in environments, so the
+ * compiler tracks stack slots itself and turns locals captured by inner
+ * functions into upvalues.
+ **/
+class Compiler : public ExprVisitor, public StmtVisitor {
+public:
+  explicit Compiler(ErrorReporter &errorReporter);
+  ExprVisitorResT visitBinaryExpr(const Binary &expr) override;
+  ExprVisitorResT visitGroupingExpr(const Grouping &expr) override;
+  ExprVisitorResT visitLiteralExpr(const Literal &expr) override;
+  ExprVisitorResT visitUnaryExpr(const Unary &expr) override;
+  ExprVisitorResT visitVariableExpr(const Variable &expr) override;
+  ExprVisitorResT visitAssignmentExpr(const Assignment &expr) override;
+  ExprVisitorResT visitLogicalExpr(const Logical &expr) override;
+  ExprVisitorResT visitCallExpr(const Call &expr) override;
+  ExprVisitorResT visitGetExpr(const Get &expr) override;
+  ExprVisitorResT visitSetExpr(const Set &expr) override;
+  ExprVisitorResT visitThisExpr(const This &expr) override;
+  ExprVisitorResT visitSuperExpr(const Super &expr) override;
+  StmtVisitorResT visitPrintStmt(const PrintStmt &stmt) override;
+  StmtVisitorResT visitExpressionStmt(const ExpressionStmt &stmt) override;
+  StmtVisitorResT visitVarDecl(const VarDecl &stmt) override;
+  StmtVisitorResT visitBlock(const Block &block) override;
+  StmtVisitorResT visitIfStmt(const IfStmt &stmt) override;
+  StmtVisitorResT visitWhileStmt(const WhileStmt &stmt) override;
+  StmtVisitorResT visitFunStmt(const FunStmt &stmt) override;
+  StmtVisitorResT visitReturnStmt(const ReturnStmt &stmt) override;
+  StmtVisitorResT visitClassStmt(const ClassStmt &stmt) override;
+  // Returns the top-level script function, or nullptr on error.
+  VmFunctionPtr compile(const std::vector<StmtPtr> &stmts);
+
+private:
+  struct Local {
+    // views the Program's source, which outlives compilation
+    std::string_view name;
+    // -1 while the local is declared but its initializer has not run
+    int depth;
+    bool isCaptured;
+  };
+
+  struct UpvalueRef {
+    uint8_t index;
+    // true: captures a local of the enclosing function
+    // false: captures one of the enclosing function's upvalues
+    bool isLocal;
+  };
+
+  struct FunctionState {
+    FunctionState *enclosing;
+    VmFunctionPtr function;
+    FunctionType type;
+    std::vector<Local> locals;
+    std::vector<UpvalueRef> upvalues;
+    int scopeDepth;
+  };
+
+  void compile(const StmtPtr &stmt);
+  void compile(const ExprPtr &expr);
+  void compile(const Expr &expr);
+  void function(const FunStmt &fun, FunctionType type);
+  void call(const Call &expr, bool tail);
+  void beginScope();
+  void endScope();
+  void declareLocal(std::string_view name, int line);
+  void markInitialized();
+  int resolveLocal(FunctionState *state, std::string_view name);
+  int resolveUpvalue(FunctionState *state, std::string_view name);
+  int addUpvalue(FunctionState *state, uint8_t index, bool isLocal);
+  void getVariable(const Binding &binding, const Token &name);
+  void setVariable(const Binding &binding, const Token &name);
+  void getLocalOrUpvalue(std::string_view name, int line);
+  void defineVariable(const Binding &binding);
+
+  Chunk &chunk() { return current_->function->chunk; }
+  void emit(uint8_t byte) { chunk().write(byte); }
+  void emit(OpCode op) { chunk().write(op); }
+  void emitShort(int value);
+  void emitConstant(const Value &value);
+  int makeConstant(const Value &value);
+  int propertySite(const Token &name);
+  int nameConstant(const Token &name);
+  int emitJump(OpCode op);
+  void patchJump(int offset);
+  void emitLoop(int loopStart);
+  void emitReturn();
+  void error(const std::string &msg);
+
+  ErrorReporter &errorReporter_;
+  FunctionState *current_;
+  // line of the last token seen, for compile errors
+  int line_;
+  bool hadError_;
+};
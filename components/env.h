@@ -1,29 +1,58 @@
 #pragma once
 
-#include "token.h"
-#include <any>
-#include <memory>
-#include <unordered_map>
+#include "binding.h"
+#include "gc.h"
+#include "object.h"
+#include "value.h"
+#include <string>
+#include <vector>
 
 class Environment;
-using EnvPtr = std::shared_ptr<Environment>;
+using EnvPtr = Environment *;
 
-class Environment {
+/**
+ * Variables that closures capture are stored in their scope's
+ * Environment, in a slot array indexed by the slot the Resolver
+ * assigned. Slots are handed out in declaration order, so defining a
+ * variable is just an append. All other locals live in the Interpreter's
+ * stack frames, and scopes without captured variables get no
+ * Environment at all.
+ *
+ * Globals live in the GlobalTable instead; the global Environment is only
+ * the (empty) root of every closure chain.
+ *
+ * Closures keep their defining Environment alive, so environments are
+ * heap objects managed by the garbage collector like any other.
+ **/
+class Environment : public Object {
 public:
   Environment(EnvPtr enclosing = nullptr)
-      : enclosing_(enclosing), values_({}) {}
-  void define(const std::string &name, std::any value) {
-    values_[name] = std::move(value);
+      : Object(ObjType::ENVIRONMENT), enclosing_(enclosing), slots_() {}
+  std::string str() const override { return "<environment>"; }
+  void trace(GC &gc) const override {
+    gc.mark(enclosing_);
+    for (const Value &value : slots_) {
+      gc.mark(value);
+    }
+  }
+  void define(Value value) { slots_.push_back(value); }
+  void assignAt(const Location &loc, const Value &value) {
+    ancestor(loc.depth)->slots_[loc.slot] = value;
+  }
+  const Value &getAt(const Location &loc) {
+    return ancestor(loc.depth)->slots_[loc.slot];
   }
-  void assign(const Token &name, const std::any &value);
-  void assignAt(int dist, const Token &name, const std::any &value);
-  std::any get(const Token &token);
-  std::any getAt(int dist, const std::string &name);
   EnvPtr enclosing() { return enclosing_; }
 
 private:
-  Environment *ancestor(int dist);
+  Environment *ancestor(int dist) {
+    Environment *environment = this;
+    for (int i = 0; i < dist; i++) {
+      environment = environment->enclosing_;
+    }
+    return environment;
+  }
 
   EnvPtr enclosing_;
-  std::unordered_map<std::string, std::any> values_;
+  std::vector<Value> slots_;
 };
@@ -1,5 +1,9 @@
 #include "expr.h"
 
+Call::Call(ExprPtr callee, const Token &paren, std::vector<ExprPtr> arguments)
+    : callee(callee), paren(paren), arguments(std::move(arguments)),
+      getCallee(dynamic_cast<const Get *>(callee)) {}
+
 ExprVisitorResT Binary::accept(ExprVisitor &visitor) const {
   return visitor.visitBinaryExpr(*this);
 }
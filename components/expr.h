@@ -1,11 +1,13 @@
 #pragma once
 
+#include "binding.h"
+#include "shape.h"
 #include "token.h"
-#include <any>
-#include <memory>
+#include "value.h"
+#include <cstdint>
 #include <vector>
 
-using ExprVisitorResT = std::any;
+using ExprVisitorResT = Value;
 
 class ExprVisitor;
 
@@ -15,49 +17,72 @@ public:
   virtual ~Expr() = default;
 };
 
-using ExprPtr = std::unique_ptr<Expr>;
+// Nodes are owned by the AstArena of their Program (see program.h).
+using ExprPtr = const Expr *;
+
+/**
+ * Type feedback for Binary nodes. A node starts UNINITIALIZED and, on its
+ * first evaluation, specializes on the operator and the operand types it
+ * saw. A specialized node only checks its guard; when the guard fails the
+ * node is rewritten to GENERIC for good.
+ **/
+enum class BinarySpecialization : uint8_t {
+  UNINITIALIZED,
+  ADD_NUMBERS,
+  CONCAT_STRINGS,
+  SUBTRACT_NUMBERS,
+  MULTIPLY_NUMBERS,
+  DIVIDE_NUMBERS,
+  GREATER_NUMBERS,
+  GREATER_EQUAL_NUMBERS,
+  LESS_NUMBERS,
+  LESS_EQUAL_NUMBERS,
+  GENERIC,
+};
 
 class Binary : public Expr {
 public:
   Binary(ExprPtr left, const Token &op, ExprPtr right)
-      : left(std::move(left)), op(op), right(std::move(right)) {}
+      : left(left), op(op), right(right) {}
   ExprVisitorResT accept(ExprVisitor &visitor) const override;
 
   const ExprPtr left;
   const Token op;
   const ExprPtr right;
+  mutable BinarySpecialization specialization =
+      BinarySpecialization::UNINITIALIZED;
 };
 
-using BinaryPtr = std::unique_ptr<Binary>;
+using BinaryPtr = const Binary *;
 
 class Grouping : public Expr {
 public:
-  explicit Grouping(ExprPtr expr) : expr(std::move(expr)) {}
+  explicit Grouping(ExprPtr expr) : expr(expr) {}
   ExprVisitorResT accept(ExprVisitor &visitor) const override;
 
   const ExprPtr expr;
 };
 
-using GroupingPtr = std::unique_ptr<Grouping>;
+using GroupingPtr = const Grouping *;
 
 class Literal : public Expr {
 public:
-  explicit Literal(std::any value) : value(std::move(value)) {}
+  explicit Literal(Value value) : value(value) {}
   ExprVisitorResT accept(ExprVisitor &visitor) const override;
 
-  const std::any value;
+  const Value value;
 };
-using LiteralPtr = std::unique_ptr<Literal>;
+using LiteralPtr = const Literal *;
 
 class Unary : public Expr {
 public:
-  Unary(const Token &op, ExprPtr right) : op(op), right(std::move(right)) {}
+  Unary(const Token &op, ExprPtr right) : op(op), right(right) {}
   ExprVisitorResT accept(ExprVisitor &visitor) const override;
 
   const Token op;
   const ExprPtr right;
 };
-using UnaryPtr = std::unique_ptr<Unary>;
+using UnaryPtr = const Unary *;
 
 class Variable : public Expr {
 public:
@@ -65,24 +90,25 @@ public:
   ExprVisitorResT accept(ExprVisitor &visitor) const override;
 
   const Token name;
+  mutable Binding binding;
 };
-using VariablePtr = std::unique_ptr<Variable>;
+using VariablePtr = const Variable *;
 
 class Assignment : public Expr {
 public:
-  Assignment(const Token &name, ExprPtr value)
-      : name(name), value(std::move(value)) {}
+  Assignment(const Token &name, ExprPtr value) : name(name), value(value) {}
   ExprVisitorResT accept(ExprVisitor &visitor) const override;
 
   const Token name;
   const ExprPtr value;
+  mutable Binding binding;
 };
-using AssignmentPtr = std::unique_ptr<Assignment>;
+using AssignmentPtr = const Assignment *;
 
 class Logical : public Expr {
 public:
   Logical(const Token &op, ExprPtr left, ExprPtr right)
-      : op(op), left(std::move(left)), right(std::move(right)) {}
+      : op(op), left(left), right(right) {}
   ExprVisitorResT accept(ExprVisitor &visitor) const override;
 
   const Token op;
@@ -90,48 +116,49 @@ public:
   const ExprPtr right;
 };
 
-using LogicalPtr = std::unique_ptr<Logical>;
+using LogicalPtr = const Logical *;
+
+class Get;
 
 class Call : public Expr {
 public:
-  Call(ExprPtr callee, const Token &paren, std::vector<ExprPtr> arguments)
-      : callee(std::move(callee)), paren(paren),
-        arguments(std::move(arguments)) {}
+  Call(ExprPtr callee, const Token &paren, std::vector<ExprPtr> arguments);
   ExprVisitorResT accept(ExprVisitor &visitor) const override;
 
   const ExprPtr callee;
   const Token paren;
   const std::vector<ExprPtr> arguments;
+  // callee as a Get for method invocations (obj.method(...)), or nullptr
+  const Get *const getCallee;
 };
 
-using CallPtr = std::unique_ptr<Call>;
+using CallPtr = const Call *;
 
 class Get : public Expr {
 public:
-  Get(ExprPtr object, const Token &name)
-      : object(std::move(object)), name(name) {}
+  Get(ExprPtr object, const Token &name) : object(object), name(name) {}
   ExprVisitorResT accept(ExprVisitor &visitor) const override;
 
-  // HACK: not const as we may need to move it to Set
-  // during parsing.
-  ExprPtr object;
+  const ExprPtr object;
   const Token name;
+  mutable PropertyCache cache;
 };
 
-using GetPtr = std::unique_ptr<Get>;
+using GetPtr = const Get *;
 
 class Set : public Expr {
 public:
   Set(ExprPtr object, const Token &name, ExprPtr value)
-      : object(std::move(object)), name(name), value(std::move(value)) {}
+      : object(object), name(name), value(value) {}
   ExprVisitorResT accept(ExprVisitor &visitor) const override;
 
   const ExprPtr object;
   const Token name;
   const ExprPtr value;
+  mutable PropertyCache cache;
 };
 
-using SetPtr = std::unique_ptr<Set>;
+using SetPtr = const Set *;
 
 class This : public Expr {
 public:
@@ -139,9 +166,10 @@ public:
   ExprVisitorResT accept(ExprVisitor &visitor) const override;
 
   const Token keyword;
+  mutable Binding binding;
 };
 
-using ThisPtr = std::unique_ptr<This>;
+using ThisPtr = const This *;
 
 class Super : public Expr {
 public:
@@ -151,9 +179,12 @@ public:
 
   const Token keyword;
   const Token method;
+  mutable Binding binding;
+  // the receiver the method gets bound to
+  mutable Binding thisBinding;
 };
 
-using SuperPtr = std::unique_ptr<Super>;
+using SuperPtr = const Super *;
 
 class ExprVisitor {
 public:
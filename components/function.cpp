@@ -1,35 +1,110 @@
 #include "function.h"
 
 #include "env.h"
+#include "gc.h"
 #include "instance.h"
 #include "interpreter.h"
+#include <algorithm>
 #include <memory>
 
-std::any LoxFunction::call(Interpreter &ip, const std::vector<std::any> &args) {
-  auto env = std::make_shared<Environment>(closure_);
-  for (int i = 0; i < arity(); i++) {
-    auto name = funDecl.params[i].lexeme;
-    env->define(name, args[i]);
+Value LoxFunction::call(Interpreter &ip, Args args) {
+  return callMethod(ip, receiver_, args);
+}
+
+Value LoxFunction::callMethod(Interpreter &ip, const Value &receiver,
+                              Args args) {
+  if (!funDecl.pure || !memoConfig().enabled || !MemoTable::cacheable(args)) {
+    return run(ip, receiver, args);
+  }
+  if (memo_ == nullptr) {
+    memo_ = std::make_unique<MemoTable>();
+  }
+  if (const Value *result = memo_->find(args)) {
+    return *result;
   }
-  try {
-    ip.executeBlock(funDecl.body, env);
-  } catch (Return *e) {
-    if (isInitializer_)
-      return closure_->getAt(0, "this");
-    return e->value;
+  Value result = run(ip, receiver, args);
+  memo_->insert(args, result);
+  return result;
+}
+
+Value LoxFunction::run(Interpreter &ip, const Value &receiver,
+                       Args args) {
+  Value result = execute(ip, receiver, args);
+  // calls in tail position are made here, after the frame that made them
+  // is gone, so tail recursion doesn't grow any stack
+  while (ip.hasTailCall()) {
+    // the pending call may make the next one, so move it out first
+    LoxFunction *method = ip.tailCall().method;
+    Value receiver = ip.tailCall().receiver;
+    Callable *callee = ip.tailCall().callee;
+    TempRoots roots(receiver);
+    if (method != nullptr) {
+      roots.add(method);
+    } else {
+      roots.add(callee);
+    }
+    Interpreter::Arguments arguments(ip);
+    for (const Value &arg : ip.tailCall().args) {
+      arguments.push(arg);
+    }
+    ip.clearTailCall();
+
+    Args args = arguments.args();
+    if (method != nullptr) {
+      result = method->execute(ip, receiver, args);
+    } else if (callee->type == ObjType::FUNCTION) {
+      auto *fun = static_cast<LoxFunction *>(callee);
+      result = fun->execute(ip, fun->receiver_, args);
+    } else {
+      // natives and classes
+      result = callee->call(ip, args);
+    }
   }
-  if (isInitializer_)
-    return closure_->getAt(0, "this");
-  return std::any();
+  return result;
 }
 
-std::string LoxFunction::str() {
-  return "<func name: " + funDecl.name.lexeme +
+Value LoxFunction::execute(Interpreter &ip, const Value &receiver,
+                           Args args) {
+  Interpreter::Frame frame(ip, funDecl.frameSize);
+  Value *slots = frame.slots();
+  if (type_ == FunctionType::METHOD || type_ == FunctionType::INIT) {
+    *slots++ = receiver;
+  }
+  std::copy(args.begin(), args.begin() + arity(), slots);
+
+  // only functions whose own variables are captured need an Environment
+  EnvPtr env = closure_;
+  if (funDecl.needsEnvironment) {
+    env = makeObj<Environment>(closure_);
+    for (int slot : funDecl.capturedParams) {
+      env->define(frame.slots()[slot]);
+    }
+  }
+  Completion completion = body_ != nullptr
+                              ? ip.executeBlock(*body_, env)
+                              : ip.executeBlock(funDecl.body, env);
+  if (type_ == FunctionType::INIT)
+    return receiver;
+  if (completion == Completion::RETURN)
+    return ip.takeReturnValue();
+  return Value();
+}
+
+std::string LoxFunction::str() const {
+  return "<func name: " + std::string(funDecl.name.lexeme) +
          ", arity: " + std::to_string(arity()) + ">";
 }
 
-FunPtr LoxFunction::bind(InstancePtr inst) {
-  EnvPtr env = std::make_shared<Environment>(closure_);
-  env->define("this", inst);
-  return std::make_shared<LoxFunction>(funDecl, isInitializer_, env);
+FunPtr LoxFunction::bind(LoxInstance *inst) {
+  auto bound = makeObj<LoxFunction>(funDecl, type_, closure_, body_);
+  bound->receiver_ = inst;
+  return bound;
+}
+
+void LoxFunction::trace(GC &gc) const {
+  gc.mark(closure_);
+  gc.mark(receiver_);
+  if (memo_ != nullptr) {
+    memo_->trace(gc);
+  }
 }
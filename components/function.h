@@ -2,27 +2,48 @@
 
 #include "callable.h"
 #include "env.h"
+#include "interpreter.h"
+#include "memo.h"
 #include "stmt.h"
 #include <memory>
 #include <string>
 
 class LoxFunction;
 class LoxInstance;
-using FunPtr = std::shared_ptr<LoxFunction>;
+using FunPtr = LoxFunction *;
 
 class LoxFunction : public Callable {
 public:
-  LoxFunction(const FunStmt &funDecl, bool isInitializer, EnvPtr closure)
-      : funDecl(funDecl), arity_(funDecl.params.size()),
-        isInitializer_(isInitializer), closure_(closure) {}
-  std::any call(Interpreter &ip, const std::vector<std::any> &args) override;
+  // body is set when the ClosureCompiler compiled funDecl; otherwise the
+  // tree-walker executes the AST.
+  LoxFunction(const FunStmt &funDecl, FunctionType type, EnvPtr closure,
+              std::shared_ptr<const CompiledBody> body = nullptr)
+      : Callable(ObjType::FUNCTION), funDecl(funDecl),
+        arity_(funDecl.params.size()), type_(type), closure_(closure),
+        body_(std::move(body)) {}
+  Value call(Interpreter &ip, Args args) override;
+  // Calls a method with `receiver` as "this", without binding it first.
+  Value callMethod(Interpreter &ip, const Value &receiver,
+                   Args args);
   int arity() const override { return arity_; }
-  FunPtr bind(std::shared_ptr<LoxInstance> inst);
-  std::string str();
+  FunPtr bind(LoxInstance *inst);
+  std::string str() const override;
+  void trace(GC &gc) const override;
 
 private:
+  // Runs the body once; a call it makes in tail position is left pending.
+  Value execute(Interpreter &ip, const Value &receiver,
+                Args args);
+  Value run(Interpreter &ip, const Value &receiver,
+            Args args);
+
   const FunStmt &funDecl;
   const int arity_;
-  const bool isInitializer_;
+  const FunctionType type_;
   EnvPtr closure_;
+  std::shared_ptr<const CompiledBody> body_;
+  // "this" of a bound method
+  Value receiver_;
+  // results by arguments, created on the first memoized call
+  std::unique_ptr<MemoTable> memo_;
 };
@@ -0,0 +1,89 @@
+#include "gc.h"
+#include <algorithm>
+#include <chrono>
+
+constinit GC heap;
+
+GC::~GC() {
+  while (objects_ != nullptr) {
+    Object *next = objects_->next_;
+    delete objects_;
+    objects_ = next;
+  }
+}
+
+void GC::configure(const GCConfig &config) {
+  config_ = config;
+  threshold_ = config.initialThreshold;
+}
+
+void GC::addRoots(RootSource *source) { rootSources_.push_back(source); }
+
+void GC::removeRoots(RootSource *source) {
+  rootSources_.erase(
+      std::remove(rootSources_.begin(), rootSources_.end(), source),
+      rootSources_.end());
+}
+
+void GC::track(Object *obj, size_t size) {
+  obj->size_ = static_cast<uint32_t>(size);
+  obj->next_ = objects_;
+  objects_ = obj;
+  stats_.objectsAllocated++;
+  stats_.bytesAllocated += obj->size_;
+  stats_.liveBytes += obj->size_;
+  stats_.peakBytes = std::max(stats_.peakBytes, stats_.liveBytes);
+}
+
+void GC::charge(const Object *obj, size_t bytes) {
+  // interned strings aren't on the heap, so they aren't accounted for
+  if (obj->size_ == 0)
+    return;
+  const_cast<Object *>(obj)->size_ += static_cast<uint32_t>(bytes);
+  stats_.bytesAllocated += bytes;
+  stats_.liveBytes += bytes;
+  stats_.peakBytes = std::max(stats_.peakBytes, stats_.liveBytes);
+}
+
+void GC::collect() {
+  auto start = std::chrono::steady_clock::now();
+  for (RootSource *source : rootSources_) {
+    source->markRoots(*this);
+  }
+  for (const Value &value : tempRoots_) {
+    mark(value);
+  }
+  // An explicit worklist keeps deep structures (long ropes, environment
+  // chains) from overflowing the native stack.
+  while (!gray_.empty()) {
+    const Object *obj = gray_.back();
+    gray_.pop_back();
+    obj->trace(*this);
+  }
+  sweep();
+  threshold_ = std::max(config_.initialThreshold,
+                        static_cast<size_t>(static_cast<double>(
+                                                stats_.liveBytes) *
+                                            config_.growthFactor));
+  stats_.collections++;
+  stats_.pauseSeconds += std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+}
+
+void GC::sweep() {
+  Object **link = &objects_;
+  while (*link != nullptr) {
+    Object *obj = *link;
+    if (obj->marked_) {
+      obj->marked_ = false;
+      link = &obj->next_;
+    } else {
+      *link = obj->next_;
+      stats_.objectsFreed++;
+      stats_.bytesFreed += obj->size_;
+      stats_.liveBytes -= obj->size_;
+      delete obj;
+    }
+  }
+}
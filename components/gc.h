@@ -0,0 +1,150 @@
+#pragma once
+
+#include "object.h"
+#include "value.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * Precise mark-sweep garbage collector for Lox heap objects.
+ *
+ * Every object created with makeObj is linked into the heap list. When
+ * the live heap would grow past the current threshold, the allocation
+ * first runs a collection: the registered RootSources mark what they
+ * refer to directly (environments, stacks, globals), marking propagates
+ * through Object::trace using an explicit worklist, and every object left
+ * unmarked is deleted. The next threshold is then the surviving heap
+ * times the growth factor.
+ *
+ * A Value held only by a C++ local is invisible to the collector, so code
+ * that keeps one across an allocation must root it with TempRoots.
+ * Interned strings are never on the heap list and are never collected.
+ **/
+
+struct GCConfig {
+  // live heap size that triggers the first collection
+  size_t initialThreshold = 1024 * 1024;
+  // next threshold = surviving bytes * growthFactor
+  double growthFactor = 2.0;
+  // collect before every allocation, to shake out missing roots
+  bool stress = false;
+};
+
+struct GCStats {
+  size_t collections = 0;
+  size_t objectsAllocated = 0;
+  size_t objectsFreed = 0;
+  size_t bytesAllocated = 0;
+  size_t bytesFreed = 0;
+  size_t liveBytes = 0;
+  size_t peakBytes = 0;
+  double pauseSeconds = 0;
+};
+
+class GC;
+
+// Anything holding references the collector can't find by tracing from
+// another object: an interpreter's environments, the VM's stack.
+class RootSource {
+public:
+  virtual ~RootSource() = default;
+  virtual void markRoots(GC &gc) = 0;
+};
+
+class GC {
+public:
+  constexpr GC() = default;
+  GC(const GC &) = delete;
+  GC &operator=(const GC &) = delete;
+  ~GC();
+
+  void configure(const GCConfig &config);
+  const GCStats &stats() const { return stats_; }
+  void addRoots(RootSource *source);
+  void removeRoots(RootSource *source);
+
+  void mark(const Object *obj) {
+    if (obj != nullptr && !obj->marked_) {
+      const_cast<Object *>(obj)->marked_ = true;
+      gray_.push_back(obj);
+    }
+  }
+  void mark(const Value &value) {
+    if (value.isObj())
+      mark(value.asObj());
+  }
+
+  // Must be called before constructing an object of `size` bytes; the
+  // collection it may trigger can't see the new object yet.
+  void reserve(size_t size) {
+    if (paused_ == 0 &&
+        (config_.stress || stats_.liveBytes + size > threshold_)) {
+      collect();
+    }
+  }
+  // Hands a freshly constructed object over to the collector.
+  void track(Object *obj, size_t size);
+  // Charges memory an object allocated after construction to the heap.
+  void charge(const Object *obj, size_t bytes);
+  void collect();
+
+  void pause() { paused_++; }
+  void resume() { paused_--; }
+
+  size_t tempRootCount() const { return tempRoots_.size(); }
+  void pushTempRoot(const Value &value) { tempRoots_.push_back(value); }
+  void popTempRoots(size_t count) {
+    tempRoots_.erase(tempRoots_.begin() + count, tempRoots_.end());
+  }
+
+private:
+  void sweep();
+
+  GCConfig config_;
+  GCStats stats_;
+  size_t threshold_ = GCConfig().initialThreshold;
+  int paused_ = 0;
+  Object *objects_ = nullptr;
+  std::vector<const Object *> gray_;
+  std::vector<RootSource *> rootSources_;
+  std::vector<Value> tempRoots_;
+};
+
+// Constant-initialized, so it is usable from other globals' constructors
+// and outlives them.
+extern constinit GC heap;
+
+inline GC &gc() { return heap; }
+
+template <typename T, typename... Args> T *makeObj(Args &&...args) {
+  GC &heap = gc();
+  heap.reserve(sizeof(T));
+  T *obj = new T(std::forward<Args>(args)...);
+  heap.track(obj, sizeof(T));
+  return obj;
+}
+
+// Roots Values that only C++ code refers to until the scope ends.
+class TempRoots {
+public:
+  TempRoots() : height_(gc().tempRootCount()) {}
+  explicit TempRoots(const Value &value) : TempRoots() { add(value); }
+  TempRoots(const TempRoots &) = delete;
+  TempRoots &operator=(const TempRoots &) = delete;
+  ~TempRoots() { gc().popTempRoots(height_); }
+  void add(const Value &value) { gc().pushTempRoot(value); }
+
+private:
+  size_t height_;
+};
+
+// No collections while in scope, e.g. while a compiler builds objects
+// that nothing roots yet.
+class GCPause {
+public:
+  GCPause() { gc().pause(); }
+  GCPause(const GCPause &) = delete;
+  GCPause &operator=(const GCPause &) = delete;
+  ~GCPause() { gc().resume(); }
+};
@@ -0,0 +1,26 @@
+#include "globals.h"
+#include "error.h"
+#include "gc.h"
+
+int GlobalTable::slotFor(const LoxString *name) {
+  auto found = slots_.find(name);
+  if (found != slots_.end()) {
+    return found->second;
+  }
+  int slot = values_.size();
+  slots_[name] = slot;
+  names_.push_back(name);
+  values_.push_back(Value::undefined());
+  return slot;
+}
+
+void GlobalTable::trace(GC &gc) const {
+  for (const Value &value : values_) {
+    gc.mark(value);
+  }
+}
+
+void GlobalTable::undefinedVariable(const Token &name) {
+  throw RuntimeError("[Line " + std::to_string(name.line) +
+                     "] Undefined variable : " + std::string(name.lexeme));
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "loxstring.h"
+#include "token.h"
+#include "value.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Global variables, indexed by a slot the Resolver assigns to each global
+ * name. A slot exists as soon as any code mentions the name, which lets a
+ * function refer to a global that is only defined later; until then the
+ * slot holds Value::undefined() and reading it is a runtime error.
+ *
+ * The table lives as long as the Interpreter, so slots stay valid across
+ * REPL lines.
+ **/
+class GC;
+
+class GlobalTable {
+public:
+  int slotFor(const LoxString *name);
+  std::string name(int slot) const {
+    return std::string(names_[slot]->chars());
+  }
+  void define(int slot, Value value) { values_[slot] = std::move(value); }
+  void define(const std::string &name, Value value) {
+    define(slotFor(intern(name)), std::move(value));
+  }
+  // Unchecked access for engines that report undefined globals themselves.
+  Value &at(int slot) { return values_[slot]; }
+  const Value &get(int slot, const Token &name) const {
+    const Value &value = values_[slot];
+    if (value.isUndefined())
+      undefinedVariable(name);
+    return value;
+  }
+  void trace(GC &gc) const;
+  void assign(int slot, const Token &name, const Value &value) {
+    if (values_[slot].isUndefined())
+      undefinedVariable(name);
+    values_[slot] = value;
+  }
+  [[noreturn]] static void undefinedVariable(const Token &name);
+
+private:
+
+  SymbolMap<int> slots_;
+  std::vector<const LoxString *> names_;
+  std::vector<Value> values_;
+};
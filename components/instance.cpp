@@ -1,16 +1,79 @@
 #include "instance.h"
 #include "error.h"
+#include "gc.h"
+#include "interpreter.h"
 
-std::any LoxInstance::get(const Token &name) {
-  if (fields_.find(name.lexeme) != fields_.end()) {
-    return fields_.at(name.lexeme);
+Value LoxInstance::get(const Token &name, PropertyCache &cache) {
+  Value field;
+  if (LoxFunction *method = getForCall(name, cache, field)) {
+    TempRoots roots(this);
+    return method->bind(this);
+  }
+  return field;
+}
+
+LoxFunction *LoxInstance::getForCall(const Token &name, PropertyCache &cache,
+                                     Value &field) {
+  if (const PropertyCache::Entry *entry = cache.find(shape_)) {
+    if (entry->slot >= 0) {
+      field = fields_[entry->slot];
+      return nullptr;
+    }
+    return entry->method;
+  }
+
+  int slot = shape_->lookup(name.symbol());
+  if (slot >= 0) {
+    cache.add({shape_->id(), slot, nullptr, nullptr});
+    field = fields_[slot];
+    return nullptr;
   }
 
-  FunPtr method = klass_->findMethod(name.lexeme);
+  FunPtr method = klass_->findMethod(name.symbol());
   if (method != nullptr) {
-    return method->bind(shared_from_this());
+    cache.add({shape_->id(), -1, method, nullptr});
+    return method;
+  }
+
+  undefinedProperty(name);
+}
+
+void LoxInstance::set(const Token &name, const Value &value,
+                      PropertyCache &cache) {
+  if (const PropertyCache::Entry *entry = cache.find(shape_)) {
+    if (entry->next == nullptr) {
+      fields_[entry->slot] = value;
+    } else {
+      addField(entry->next, value);
+    }
+    return;
+  }
+
+  int slot = shape_->lookup(name.symbol());
+  if (slot >= 0) {
+    cache.add({shape_->id(), slot, nullptr, nullptr});
+    fields_[slot] = value;
+    return;
+  }
+  Shape *next = shape_->transition(name.symbol());
+  cache.add({shape_->id(), static_cast<int>(fields_.size()), nullptr, next});
+  addField(next, value);
+}
+
+void LoxInstance::addField(Shape *next, const Value &value) {
+  size_t capacity = fields_.capacity();
+  if (capacity == 0) {
+    // as many fields as instances of the class have grown to so far
+    fields_.reserve(shape_->expectedFields());
   }
+  shape_ = next;
+  fields_.push_back(value);
+  gc().charge(this, (fields_.capacity() - capacity) * sizeof(Value));
+}
 
-  throw new RuntimeError(name.errorStr() + ". Undefined property '" +
-                         name.lexeme + "'.");
+void LoxInstance::trace(GC &gc) const {
+  gc.mark(klass_);
+  for (const Value &value : fields_) {
+    gc.mark(value);
+  }
 }
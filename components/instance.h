@@ -1,23 +1,33 @@
 #pragma once
 
 #include "class.h"
+#include "shape.h"
 #include "token.h"
 #include <memory>
-#include <unordered_map>
+#include <vector>
 
-class LoxInstance : public std::enable_shared_from_this<LoxInstance> {
+class LoxInstance : public Object {
 public:
-  explicit LoxInstance(LoxClass *klass)
-      : klass_(klass), fields_(std::unordered_map<std::string, std::any>()) {}
-  std::any get(const Token &name);
-  void set(const Token &name, const std::any &value) {
-    fields_[name.lexeme] = value;
-  }
-  std::string str() { return klass_->name() + " instance"; }
+  explicit LoxInstance(ClassPtr klass)
+      : Object(ObjType::INSTANCE), klass_(klass), shape_(klass->rootShape()) {}
+  // cache is the inline cache of the accessing Get/Set node
+  Value get(const Token &name, PropertyCache &cache);
+  // Like get(), but leaves a method unbound for call sites that invoke it
+  // directly: returns the method, or nullptr with the field in `field`.
+  LoxFunction *getForCall(const Token &name, PropertyCache &cache,
+                          Value &field);
+  void set(const Token &name, const Value &value, PropertyCache &cache);
+  std::string str() const override { return klass_->name() + " instance"; }
+  void trace(GC &gc) const override;
 
 private:
-  LoxClass *klass_;
-  std::unordered_map<std::string, std::any> fields_;
+  // moves to the shape `next` with the field value appended
+  void addField(Shape *next, const Value &value);
+
+  ClassPtr klass_;
+  // layout of fields_; owned by klass_'s shape tree
+  Shape *shape_;
+  std::vector<Value> fields_;
 };
 
-using InstancePtr = std::shared_ptr<LoxInstance>;
+using InstancePtr = LoxInstance *;
@@ -1,96 +1,271 @@
 #include "interpreter.h"
-#include "../utils/any_util.h"
+#include "../utils/value_util.h"
 #include "callable.h"
 #include "class.h"
 #include "function.h"
 #include "instance.h"
+#include "loxstring.h"
 #include "native.h"
 #include "token.h"
+#include <algorithm>
 #include <iostream>
 #include <unordered_map>
 #include <vector>
 
-namespace {
-std::uintptr_t id(const Expr &expr) {
-  return reinterpret_cast<std::uintptr_t>(&expr);
+void checkNumber(const Token &op, const Value &operand) {
+  if (operand.isNumber())
+    return;
+  throw RuntimeError(op.errorStr() + ": operand must be a number.");
 }
 
-bool isTruthy(std::any value) {
-  // only Nil and false are false; everything else is true.
-  if (!value.has_value())
-    return false;
-  if (value.type() == typeid(bool))
-    return std::any_cast<bool>(value);
-  return true;
+void checkNumbers(const Token &op, const Value &left, const Value &right) {
+  if (left.isNumber() && right.isNumber())
+    return;
+  throw RuntimeError(op.errorStr() + ": operands must be a number.");
 }
 
-void checkNumber(const Token &op, const std::any &operand) {
-  if (operand.type() == typeid(double))
+void checkArity(const Token &paren, int arity, size_t argCount) {
+  if (argCount == static_cast<size_t>(arity))
     return;
-  throw new RuntimeError(op.errorStr() + ": operand must be a number.");
+  throw RuntimeError(paren.errorStr() + " Expected " + std::to_string(arity) +
+                     " arguments but got " + std::to_string(argCount) + ".");
 }
 
-void checkNumbers(const Token &op, const std::any &left,
-                  const std::any &right) {
-  if (left.type() == typeid(double) && right.type() == typeid(double))
-    return;
-  throw new RuntimeError(op.errorStr() + ": operands must be a number.");
+Callable *checkCallable(const Token &paren, const Value &callee,
+                        size_t argCount) {
+  if (!callee.isCallable()) {
+    notCallable(paren);
+  }
+  Callable *fun = callee.as<Callable>();
+  checkArity(paren, fun->arity(), argCount);
+  return fun;
+}
+
+void notCallable(const Token &paren) {
+  throw RuntimeError(paren.errorStr() +
+                     " Can only call functions and classes.");
+}
+
+void notAnInstance(const Token &name) {
+  throw RuntimeError(name.errorStr() + " Only instances have properties.");
+}
+
+void undefinedProperty(const Token &name) {
+  throw RuntimeError(name.errorStr() + ". Undefined property '" +
+                     std::string(name.lexeme) + "'.");
+}
+
+void undefinedSuperMethod(const Token &method) {
+  throw RuntimeError(method.errorStr() + "Undefined property '" +
+                     std::string(method.lexeme) + "'.");
 }
 
+void notASuperclass(const Token &name) {
+  throw RuntimeError(name.errorStr() + " Superclass must be a class.");
+}
+
+void cannotAdd(const Token &op) {
+  throw RuntimeError(op.errorStr() +
+                     ": operands must both be either doubles or strings");
+}
+
+void stackOverflow() { throw RuntimeError("Stack overflow."); }
+
+namespace {
+const int STACK_MAX = 1 << 16;
 } // namespace
 
 Interpreter::Interpreter(ErrorReporter &errorReporter)
     : errorReporter_(errorReporter),
-      globalEnv_(std::make_shared<Environment>()), env_(globalEnv_),
-      locals_(LocalMap()) {
+      globalEnv_(makeObj<Environment>()), env_(globalEnv_),
+      stack_(new Value[STACK_MAX]), frame_(stack_.get()),
+      stackTop_(stack_.get()) {
+  gc().addRoots(this);
   // add native functions to global env
-  globalEnv_->define("clock", std::make_shared<LoxClock>());
+  defineNatives(globals_);
 }
 
-ExprVisitorResT Interpreter::visitBinaryExpr(const Binary &expr) {
-  auto left = eval(expr.left);
-  auto right = eval(expr.right);
-  switch (expr.op.type) {
+Interpreter::~Interpreter() { gc().removeRoots(this); }
+
+void Interpreter::markRoots(GC &gc) {
+  globals_.trace(gc);
+  gc.mark(globalEnv_);
+  gc.mark(env_);
+  for (const Value *slot = stack_.get(); slot < stackTop_; slot++) {
+    gc.mark(*slot);
+  }
+  gc.mark(returnValue_);
+  gc.mark(tailCall_.method);
+  gc.mark(tailCall_.receiver);
+  gc.mark(tailCall_.callee);
+  for (const Value &arg : tailCall_.args) {
+    gc.mark(arg);
+  }
+}
+
+void Interpreter::setTailCall(LoxFunction *method, const Value &receiver,
+                              Callable *callee, Args args) {
+  tailCall_.method = method;
+  tailCall_.receiver = receiver;
+  tailCall_.callee = callee;
+  tailCall_.args.assign(args.begin(), args.end());
+}
+
+void Interpreter::clearTailCall() {
+  tailCall_.method = nullptr;
+  tailCall_.receiver = Value();
+  tailCall_.callee = nullptr;
+  tailCall_.args.clear();
+}
+
+Interpreter::Frame::Frame(Interpreter &ip, int size)
+    : ip_(ip), enclosing_(ip.frame_) {
+  if (ip.stackTop_ + size > ip.stack_.get() + STACK_MAX) {
+    stackOverflow();
+  }
+  // stale slots may point at objects the GC has freed since
+  std::fill(ip.stackTop_, ip.stackTop_ + size, Value());
+  ip.frame_ = ip.stackTop_;
+  ip.stackTop_ += size;
+}
+
+Interpreter::Frame::~Frame() {
+  ip_.stackTop_ = ip_.frame_;
+  ip_.frame_ = enclosing_;
+}
+
+void Interpreter::Arguments::push(const Value &value) {
+  if (ip_.stackTop_ == ip_.stack_.get() + STACK_MAX) {
+    stackOverflow();
+  }
+  *ip_.stackTop_++ = value;
+}
+
+namespace {
+BinarySpecialization specialize(TokenType op, const Value &left,
+                                const Value &right) {
+  if (left.isNumber() && right.isNumber()) {
+    switch (op) {
+    case TokenType::PLUS:
+      return BinarySpecialization::ADD_NUMBERS;
+    case TokenType::MINUS:
+      return BinarySpecialization::SUBTRACT_NUMBERS;
+    case TokenType::STAR:
+      return BinarySpecialization::MULTIPLY_NUMBERS;
+    case TokenType::SLASH:
+      return BinarySpecialization::DIVIDE_NUMBERS;
+    case TokenType::GREATER:
+      return BinarySpecialization::GREATER_NUMBERS;
+    case TokenType::GREATER_EQUAL:
+      return BinarySpecialization::GREATER_EQUAL_NUMBERS;
+    case TokenType::LESS:
+      return BinarySpecialization::LESS_NUMBERS;
+    case TokenType::LESS_EQUAL:
+      return BinarySpecialization::LESS_EQUAL_NUMBERS;
+    default:
+      break;
+    }
+  } else if (op == TokenType::PLUS && left.isString() && right.isString()) {
+    return BinarySpecialization::CONCAT_STRINGS;
+  }
+  return BinarySpecialization::GENERIC;
+}
+
+Value evalBinary(const Token &op, const Value &left, const Value &right) {
+  switch (op.type) {
   case TokenType::MINUS:
-    checkNumbers(expr.op, left, right);
-    return std::any_cast<double>(left) - std::any_cast<double>(right);
+    checkNumbers(op, left, right);
+    return left.asNumber() - right.asNumber();
   case TokenType::SLASH:
-    checkNumbers(expr.op, left, right);
-    return std::any_cast<double>(left) / std::any_cast<double>(right);
+    checkNumbers(op, left, right);
+    return left.asNumber() / right.asNumber();
   case TokenType::STAR:
-    checkNumbers(expr.op, left, right);
-    return std::any_cast<double>(left) * std::any_cast<double>(right);
+    checkNumbers(op, left, right);
+    return left.asNumber() * right.asNumber();
   case TokenType::PLUS:
-    if (left.type() == typeid(double) && right.type() == typeid(double)) {
-      return std::any_cast<double>(left) + std::any_cast<double>(right);
+    if (left.isNumber() && right.isNumber()) {
+      return left.asNumber() + right.asNumber();
     }
-    if (left.type() == typeid(std::string) &&
-        right.type() == typeid(std::string)) {
-      return std::any_cast<std::string>(left) +
-             std::any_cast<std::string>(right);
+    if (left.isString() && right.isString()) {
+      return concatenate(left.as<LoxString>(), right.as<LoxString>());
     }
-    throw new RuntimeError(expr.op.errorStr() +
-                           ": operands must both be either doubles or strings");
+    cannotAdd(op);
   case TokenType::GREATER:
-    checkNumbers(expr.op, left, right);
-    return std::any_cast<double>(left) > std::any_cast<double>(right);
+    checkNumbers(op, left, right);
+    return left.asNumber() > right.asNumber();
   case TokenType::GREATER_EQUAL:
-    checkNumbers(expr.op, left, right);
-    return std::any_cast<double>(left) >= std::any_cast<double>(right);
+    checkNumbers(op, left, right);
+    return left.asNumber() >= right.asNumber();
   case TokenType::LESS:
-    checkNumbers(expr.op, left, right);
-    return std::any_cast<double>(left) < std::any_cast<double>(right);
+    checkNumbers(op, left, right);
+    return left.asNumber() < right.asNumber();
   case TokenType::LESS_EQUAL:
-    checkNumbers(expr.op, left, right);
-    return std::any_cast<double>(left) <= std::any_cast<double>(right);
+    checkNumbers(op, left, right);
+    return left.asNumber() <= right.asNumber();
   case TokenType::BANG_EQUAL:
-    return !anyEqual(left, right);
+    return !valueEqual(left, right);
   case TokenType::EQUAL_EQUAL:
-    return anyEqual(left, right);
+    return valueEqual(left, right);
   default:
     break;
   }
-  throw new RuntimeError(expr.op.errorStr() + ": unsupported binary operator");
+  throw RuntimeError(op.errorStr() + ": unsupported binary operator");
+}
+} // namespace
+
+ExprVisitorResT Interpreter::visitBinaryExpr(const Binary &expr) {
+  auto left = eval(expr.left);
+  TempRoots roots;
+  if (left.isObj())
+    roots.add(left);
+  auto right = eval(expr.right);
+  bool numbers = left.isNumber() && right.isNumber();
+  switch (expr.specialization) {
+  case BinarySpecialization::ADD_NUMBERS:
+    if (numbers)
+      return left.asNumber() + right.asNumber();
+    break;
+  case BinarySpecialization::CONCAT_STRINGS:
+    if (left.isString() && right.isString())
+      return concatenate(left.as<LoxString>(), right.as<LoxString>());
+    break;
+  case BinarySpecialization::SUBTRACT_NUMBERS:
+    if (numbers)
+      return left.asNumber() - right.asNumber();
+    break;
+  case BinarySpecialization::MULTIPLY_NUMBERS:
+    if (numbers)
+      return left.asNumber() * right.asNumber();
+    break;
+  case BinarySpecialization::DIVIDE_NUMBERS:
+    if (numbers)
+      return left.asNumber() / right.asNumber();
+    break;
+  case BinarySpecialization::GREATER_NUMBERS:
+    if (numbers)
+      return left.asNumber() > right.asNumber();
+    break;
+  case BinarySpecialization::GREATER_EQUAL_NUMBERS:
+    if (numbers)
+      return left.asNumber() >= right.asNumber();
+    break;
+  case BinarySpecialization::LESS_NUMBERS:
+    if (numbers)
+      return left.asNumber() < right.asNumber();
+    break;
+  case BinarySpecialization::LESS_EQUAL_NUMBERS:
+    if (numbers)
+      return left.asNumber() <= right.asNumber();
+    break;
+  case BinarySpecialization::UNINITIALIZED:
+    expr.specialization = specialize(expr.op.type, left, right);
+    return evalBinary(expr.op, left, right);
+  case BinarySpecialization::GENERIC:
+    return evalBinary(expr.op, left, right);
+  }
+  // guard failed; stop specializing this node
+  expr.specialization = BinarySpecialization::GENERIC;
+  return evalBinary(expr.op, left, right);
 }
 
 ExprVisitorResT Interpreter::visitGroupingExpr(const Grouping &expr) {
@@ -106,52 +281,73 @@ ExprVisitorResT Interpreter::visitUnaryExpr(const Unary &expr) {
   switch (expr.op.type) {
   case TokenType::MINUS:
     checkNumber(expr.op, right);
-    return -std::any_cast<double>(right);
+    return -right.asNumber();
   case TokenType::BANG:
     return !isTruthy(right);
   default:
     break;
   }
-  throw new RuntimeError(expr.op.errorStr() + " unsupported unary operator");
+  throw RuntimeError(expr.op.errorStr() + " unsupported unary operator");
 }
 
 ExprVisitorResT Interpreter::visitVariableExpr(const Variable &expr) {
-  return lookUpVariable(expr.name, expr);
+  return lookUpVariable(expr.name, expr.binding);
 }
 
 ExprVisitorResT Interpreter::visitThisExpr(const This &expr) {
-  return lookUpVariable(expr.keyword, expr);
+  return lookUpVariable(expr.keyword, expr.binding);
 }
 
 ExprVisitorResT Interpreter::visitSuperExpr(const Super &expr) {
-  // should always have 'super' if we're visiting super here
-  int dist = locals_.at(id(expr));
-  ClassPtr superClass = any_cast<ClassPtr>(env_->getAt(dist, "super"));
-
-  // "this" exists in the environment one hop closer than the one that
-  // contains "super"
-  InstancePtr object = any_cast<InstancePtr>(env_->getAt(dist - 1, "this"));
-  FunPtr method = superClass->findMethod(expr.method.lexeme);
+  // should always have 'super' if we're visiting super here; it is only
+  // referred to from methods, so always captured
+  auto superClass = env_->getAt(expr.binding.loc);
+  auto object = lookUpVariable(expr.keyword, expr.thisBinding);
+  FunPtr method = superClass.as<LoxClass>()->findMethod(expr.method.symbol());
   if (method == nullptr) {
-    throw new RuntimeError(expr.method.errorStr() + "Undefined property '" +
-                           expr.method.lexeme + "'.");
+    undefinedSuperMethod(expr.method);
+  }
+  return method->bind(object.as<LoxInstance>());
+}
+
+Value Interpreter::lookUpVariable(const Token &name, const Binding &binding) {
+  switch (binding.type) {
+  case BindingType::LOCAL:
+    return frame_[binding.loc.slot];
+  case BindingType::CAPTURED:
+    return env_->getAt(binding.loc);
+  case BindingType::GLOBAL:
+    break;
   }
-  return method->bind(object);
+  return globals_.get(binding.loc.slot, name);
 }
 
-std::any Interpreter::lookUpVariable(const Token &name, const Expr &expr) {
-  if (locals_.find(id(expr)) != locals_.end()) {
-    return env_->getAt(locals_.at(id(expr)), name.lexeme);
+void Interpreter::declare(const Binding &binding, Value value) {
+  switch (binding.type) {
+  case BindingType::LOCAL:
+    frame_[binding.loc.slot] = value;
+    break;
+  case BindingType::CAPTURED:
+    env_->define(value);
+    break;
+  case BindingType::GLOBAL:
+    globals_.define(binding.loc.slot, value);
+    break;
   }
-  return globalEnv_->get(name);
 }
 
 ExprVisitorResT Interpreter::visitAssignmentExpr(const Assignment &expr) {
   auto value = eval(expr.value);
-  if (locals_.find(id(expr)) != locals_.end()) {
-    env_->assignAt(locals_.at(id(expr)), expr.name, value);
-  } else {
-    globalEnv_->assign(expr.name, value);
+  switch (expr.binding.type) {
+  case BindingType::LOCAL:
+    frame_[expr.binding.loc.slot] = value;
+    break;
+  case BindingType::CAPTURED:
+    env_->assignAt(expr.binding.loc, value);
+    break;
+  case BindingType::GLOBAL:
+    globals_.assign(expr.binding.loc.slot, expr.name, value);
+    break;
   }
   return value;
 }
@@ -172,54 +368,83 @@ ExprVisitorResT Interpreter::visitLogicalExpr(const Logical &expr) {
 }
 
 ExprVisitorResT Interpreter::visitCallExpr(const Call &expr) {
+  return call(expr, false);
+}
+
+// tail: record the call in tailCall_ rather than making it
+Value Interpreter::call(const Call &expr, bool tail) {
+  if (expr.getCallee != nullptr) {
+    return invokeMethod(expr, *expr.getCallee, tail);
+  }
   auto callee = eval(expr.callee);
+  TempRoots roots(callee);
 
-  std::vector<std::any> arguments;
+  Arguments arguments(*this);
   for (const auto &argument : expr.arguments) {
-    arguments.push_back(eval(argument));
+    arguments.push(eval(argument));
   }
 
-  // using any together with shared_ptr makes this tricky
-  CallablePtr fun = nullptr;
-  if (callee.type() == typeid(FunPtr)) {
-    fun = std::any_cast<FunPtr>(callee);
-  } else if (callee.type() == typeid(ClassPtr)) {
-    fun = std::any_cast<ClassPtr>(callee);
-  } else if (callee.type() == typeid(std::shared_ptr<LoxClock>)) {
-    fun = std::any_cast<std::shared_ptr<LoxClock>>(callee);
+  Args args = arguments.args();
+  Callable *fun = checkCallable(expr.paren, callee, args.size());
+  if (tail) {
+    setTailCall(nullptr, Value(), fun, args);
+    return Value();
   }
-  if (fun == nullptr) {
-    throw new RuntimeError(expr.paren.errorStr() +
-                           " Can only call functions and classes.");
+  return fun->call(*this, args);
+}
+
+// obj.method(args): calls the method with obj as its receiver instead of
+// binding it to obj first.
+Value Interpreter::invokeMethod(const Call &expr, const Get &callee,
+                                bool tail) {
+  auto object = eval(callee.object);
+  if (!object.isInstance()) {
+    notAnInstance(callee.name);
   }
+  Value field;
+  LoxFunction *method =
+      object.as<LoxInstance>()->getForCall(callee.name, callee.cache, field);
+  TempRoots roots(object);
+  roots.add(field);
 
-  if (arguments.size() != fun->arity()) {
-    throw new RuntimeError(
-        expr.paren.errorStr() + " Expected " + std::to_string(fun->arity()) +
-        " arguments but got " + std::to_string(arguments.size()) + ".");
+  Arguments arguments(*this);
+  for (const auto &argument : expr.arguments) {
+    arguments.push(eval(argument));
   }
-  return fun->call(*this, arguments);
+
+  Args args = arguments.args();
+  if (method == nullptr) {
+    Callable *fun = checkCallable(expr.paren, field, args.size());
+    if (tail) {
+      setTailCall(nullptr, Value(), fun, args);
+      return Value();
+    }
+    return fun->call(*this, args);
+  }
+  checkArity(expr.paren, method->arity(), args.size());
+  if (tail) {
+    setTailCall(method, object, nullptr, args);
+    return Value();
+  }
+  return method->callMethod(*this, object, args);
 }
 
 ExprVisitorResT Interpreter::visitGetExpr(const Get &expr) {
   auto object = eval(expr.object);
-  if (object.type() != typeid(InstancePtr)) {
-    throw new RuntimeError(expr.name.errorStr() +
-                           " Only instances have properties.");
+  if (!object.isInstance()) {
+    notAnInstance(expr.name);
   }
-  auto instance = std::any_cast<InstancePtr>(object);
-  return instance->get(expr.name);
+  return object.as<LoxInstance>()->get(expr.name, expr.cache);
 }
 
 ExprVisitorResT Interpreter::visitSetExpr(const Set &expr) {
   auto object = eval(expr.object);
-  if (object.type() != typeid(InstancePtr)) {
-    throw new RuntimeError(expr.name.errorStr() +
-                           " Only instances have properties.");
+  if (!object.isInstance()) {
+    notAnInstance(expr.name);
   }
+  TempRoots roots(object);
   auto value = eval(expr.value);
-  auto instance = std::any_cast<InstancePtr>(object);
-  instance->set(expr.name, value);
+  object.as<LoxInstance>()->set(expr.name, value, expr.cache);
   return ExprVisitorResT();
 }
 
@@ -233,20 +458,19 @@ ExprVisitorResT Interpreter::eval(const Expr &expr) {
 
 StmtVisitorResT Interpreter::visitPrintStmt(const PrintStmt &stmt) {
   auto value = eval(stmt.expr);
-  try {
-    std::cout << anyToStr(value) << std::endl;
-  } catch (std::exception *e) {
-    std::cout << "Cannot print: unsupported type " << e->what() << std::endl;
-  }
+  std::cout << valueToStr(value) << std::endl;
   return StmtVisitorResT();
 }
 
 StmtVisitorResT Interpreter::visitReturnStmt(const ReturnStmt &stmt) {
-  std::any value;
-  if (stmt.value != nullptr) {
-    value = eval(stmt.value);
+  if (stmt.tailCall) {
+    call(static_cast<const Call &>(*stmt.value), true);
+  } else if (stmt.value != nullptr) {
+    returnValue_ = eval(stmt.value);
+  } else {
+    returnValue_ = Value();
   }
-  throw new Return(std::move(value));
+  return Completion::RETURN;
 }
 
 StmtVisitorResT Interpreter::visitExpressionStmt(const ExpressionStmt &stmt) {
@@ -255,17 +479,19 @@ StmtVisitorResT Interpreter::visitExpressionStmt(const ExpressionStmt &stmt) {
 }
 
 StmtVisitorResT Interpreter::visitVarDecl(const VarDecl &stmt) {
-  std::any value;
+  Value value;
   if (stmt.initializer != nullptr) {
     value = eval(stmt.initializer);
   }
-  env_->define(stmt.name.lexeme, std::move(value));
+  declare(stmt.binding, std::move(value));
   return StmtVisitorResT();
 }
 
 StmtVisitorResT Interpreter::visitBlock(const Block &block) {
-  executeBlock(block.stmts, std::make_shared<Environment>(env_));
-  return StmtVisitorResT();
+  if (!block.needsEnvironment) {
+    return executeBlock(block.stmts, env_);
+  }
+  return executeBlock(block.stmts, makeObj<Environment>(env_));
 }
 
 StmtVisitorResT Interpreter::visitIfStmt(const IfStmt &stmt) {
@@ -274,85 +500,110 @@ StmtVisitorResT Interpreter::visitIfStmt(const IfStmt &stmt) {
   } else if (stmt.elseStmt != nullptr) {
     return execute(stmt.elseStmt);
   }
+  return StmtVisitorResT();
 }
 
 StmtVisitorResT Interpreter::visitWhileStmt(const WhileStmt &stmt) {
   while (isTruthy(eval(stmt.condition))) {
-    execute(stmt.stmt);
+    if (execute(stmt.stmt) == Completion::RETURN) {
+      return Completion::RETURN;
+    }
   }
   return StmtVisitorResT();
 }
 
 StmtVisitorResT Interpreter::visitFunStmt(const FunStmt &stmt) {
-  auto fun = std::make_shared<LoxFunction>(stmt, false, env_);
-  env_->define(stmt.name.lexeme, fun);
+  auto fun = makeObj<LoxFunction>(stmt, FunctionType::FUNCTION, env_);
+  declare(stmt.binding, fun);
   return StmtVisitorResT();
 }
 
 StmtVisitorResT Interpreter::visitClassStmt(const ClassStmt &stmt) {
   ClassPtr superPtr = nullptr;
+  TempRoots roots;
   if (stmt.super != nullptr) {
     auto superClass = eval(*stmt.super);
-    if (superClass.type() != typeid(ClassPtr)) {
-      throw new RuntimeError(stmt.super->name.errorStr() +
-                             " Superclass must be a class.");
+    if (!superClass.isClass()) {
+      notASuperclass(stmt.super->name);
     }
-    superPtr = any_cast<ClassPtr>(superClass);
+    superPtr = superClass.as<LoxClass>();
+    roots.add(superPtr);
   }
-  // Two-stage variable binding process allows references to the class
-  //  inside its own methods.
-  env_->define(stmt.name.lexeme, nullptr);
   if (superPtr != nullptr) {
-    env_ = std::make_shared<Environment>(env_);
-    env_->define("super", superPtr);
+    env_ = makeObj<Environment>(env_);
+    env_->define(superPtr);
   }
-  std::unordered_map<std::string, FunPtr> methods;
+  SymbolMap<FunPtr> methods;
   for (const auto &method : stmt.methods) {
-    FunPtr fun = std::make_shared<LoxFunction>(
-        *method, method->name.lexeme == "init", env_);
-    methods[method->name.lexeme] = fun;
+    FunctionType type = method->name.lexeme == "init" ? FunctionType::INIT
+                                                      : FunctionType::METHOD;
+    FunPtr fun = makeObj<LoxFunction>(*method, type, env_);
+    methods[method->name.symbol()] = fun;
+    roots.add(fun);
   }
 
-  auto klass = std::make_shared<LoxClass>(stmt.name.lexeme, superPtr,
-                                          std::move(methods));
+  auto klass =
+      makeObj<LoxClass>(std::string(stmt.name.lexeme), superPtr, std::move(methods));
   if (superPtr != nullptr) {
     env_ = env_->enclosing();
   }
-  env_->assign(stmt.name, klass);
+  // Methods only look the class up when they run, so binding the name
+  // after the class is built still lets them refer to it.
+  declare(stmt.binding, klass);
   return StmtVisitorResT();
 }
 
-void Interpreter::executeBlock(const std::vector<StmtPtr> &block, EnvPtr env) {
+Completion Interpreter::executeBlock(const CompiledBody &body, EnvPtr env) {
   EnvPtr enclosing = env_;
+  TempRoots roots(enclosing);
+  env_ = env;
+  Completion completion;
+  try {
+    completion = body();
+  } catch (...) {
+    env_ = enclosing;
+    throw;
+  }
+  env_ = enclosing;
+  return completion;
+}
+
+Completion Interpreter::executeBlock(const std::vector<StmtPtr> &block,
+                                     EnvPtr env) {
+  EnvPtr enclosing = env_;
+  TempRoots roots(enclosing);
 
   env_ = env;
 
   // with poor man's scope guard
+  Completion completion = Completion::NORMAL;
   try {
     for (const auto &stmt : block) {
-      execute(stmt);
+      completion = execute(stmt);
+      if (completion == Completion::RETURN) {
+        break;
+      }
     }
   } catch (...) {
     env_ = enclosing;
     throw;
   }
   env_ = enclosing;
+  return completion;
 }
 
 StmtVisitorResT Interpreter::execute(const StmtPtr &stmt) {
   return stmt->accept(*this);
 }
 
-void Interpreter::resolve(const Expr &expr, int depth) {
-  locals_[id(expr)] = depth;
-}
-
-void Interpreter::interpret(const std::vector<StmtPtr> &stmts) {
+void Interpreter::interpret(const std::vector<StmtPtr> &stmts,
+                            int frameSize) {
   try {
+    Frame frame(*this, frameSize);
     for (const auto &stmt : stmts) {
       execute(stmt);
     }
-  } catch (RuntimeError *e) {
-    errorReporter_.reportRuntimeError(*e);
+  } catch (const RuntimeError &e) {
+    errorReporter_.reportRuntimeError(e);
   }
 }
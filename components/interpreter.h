@@ -1,17 +1,58 @@
 #pragma once
 
+#include "callable.h"
 #include "env.h"
 #include "error.h"
 #include "expr.h"
+#include "gc.h"
+#include "globals.h"
 #include "stmt.h"
+#include "token.h"
+#include <cstddef>
+#include <functional>
 #include <memory>
-#include <unordered_map>
+#include <utility>
+#include <vector>
 
-using LocalMap = std::unordered_map<uintptr_t, int>;
+// A block or function body compiled by the ClosureCompiler.
+using CompiledBody = std::function<Completion()>;
 
-class Interpreter : public ExprVisitor, public StmtVisitor {
+class LoxFunction;
+
+// A call in tail position. The function making it returns right away and
+// leaves the call to its caller's LoxFunction::callMethod, which makes it
+// once the returning function's frame is gone. Tail recursion so runs in
+// constant native and interpreter stack.
+struct TailCall {
+  // method invoked on receiver, or nullptr to call callee
+  LoxFunction *method = nullptr;
+  Value receiver;
+  Callable *callee = nullptr;
+  // reused from call to call, so it stops allocating once large enough
+  std::vector<Value> args;
+};
+
+// Operand checks and runtime errors shared by all the engines, so a
+// script fails with the same message whichever one runs it.
+void checkNumber(const Token &op, const Value &operand);
+void checkNumbers(const Token &op, const Value &left, const Value &right);
+void checkArity(const Token &paren, int arity, size_t argCount);
+Callable *checkCallable(const Token &paren, const Value &callee,
+                        size_t argCount);
+[[noreturn]] void notCallable(const Token &paren);
+[[noreturn]] void notAnInstance(const Token &name);
+[[noreturn]] void undefinedProperty(const Token &name);
+[[noreturn]] void undefinedSuperMethod(const Token &method);
+[[noreturn]] void notASuperclass(const Token &name);
+[[noreturn]] void cannotAdd(const Token &op);
+[[noreturn]] void stackOverflow();
+
+class Interpreter : public ExprVisitor,
+                    public StmtVisitor,
+                    public RootSource {
 public:
   explicit Interpreter(ErrorReporter &errorReporter);
+  ~Interpreter() override;
   ExprVisitorResT visitBinaryExpr(const Binary &expr) override;
   ExprVisitorResT visitGroupingExpr(const Grouping &expr) override;
   ExprVisitorResT visitLiteralExpr(const Literal &expr) override;
@@ -33,26 +74,78 @@ public:
   StmtVisitorResT visitFunStmt(const FunStmt &stmt) override;
   StmtVisitorResT visitReturnStmt(const ReturnStmt &stmt) override;
   StmtVisitorResT visitClassStmt(const ClassStmt &stmt) override;
-  void interpret(const std::vector<StmtPtr> &stmts);
-  void executeBlock(const std::vector<StmtPtr> &block, EnvPtr env);
+  // frameSize: the Resolver's scriptFrameSize() for stmts
+  void interpret(const std::vector<StmtPtr> &stmts, int frameSize);
+  Completion executeBlock(const std::vector<StmtPtr> &block, EnvPtr env);
+  Completion executeBlock(const CompiledBody &body, EnvPtr env);
+  // value of the last executed return statement
+  Value takeReturnValue() { return std::move(returnValue_); }
+  void setReturnValue(Value value) { returnValue_ = std::move(value); }
+  bool hasTailCall() const {
+    return tailCall_.method != nullptr || tailCall_.callee != nullptr;
+  }
+  void setTailCall(LoxFunction *method, const Value &receiver,
+                   Callable *callee, Args args);
+  const TailCall &tailCall() const { return tailCall_; }
+  void clearTailCall();
+  const EnvPtr &environment() const { return env_; }
+  // slots of the running call's uncaptured locals
+  Value *frame() const { return frame_; }
   EnvPtr globalEnv() { return globalEnv_; }
-  void resolve(const Expr &expr, int depth);
+  GlobalTable &globals() { return globals_; }
+  void markRoots(GC &gc) override;
+
+  // Pushes a stack frame of `size` nil slots for a call (or for top-level
+  // code), popped again when the Frame goes out of scope.
+  class Frame {
+  public:
+    Frame(Interpreter &ip, int size);
+    ~Frame();
+    Frame(const Frame &) = delete;
+    Frame &operator=(const Frame &) = delete;
+    Value *slots() const { return ip_.frame_; }
+
+  private:
+    Interpreter &ip_;
+    Value *enclosing_;
+  };
+
+  // Arguments of a call being made, pushed onto the stack above the
+  // current frame (where the GC sees them) and popped again when the
+  // Arguments go out of scope.
+  class Arguments {
+  public:
+    explicit Arguments(Interpreter &ip) : ip_(ip), base_(ip.stackTop_) {}
+    ~Arguments() { ip_.stackTop_ = base_; }
+    Arguments(const Arguments &) = delete;
+    Arguments &operator=(const Arguments &) = delete;
+    void push(const Value &value);
+    Args args() const { return Args(base_, ip_.stackTop_); }
+
+  private:
+    Interpreter &ip_;
+    Value *base_;
+  };
 
 private:
   ExprVisitorResT eval(const ExprPtr &expr);
   ExprVisitorResT eval(const Expr &expr);
   StmtVisitorResT execute(const StmtPtr &stmt);
-  std::any lookUpVariable(const Token &name, const Expr &expr);
+  Value call(const Call &expr, bool tail);
+  Value invokeMethod(const Call &expr, const Get &callee, bool tail);
+  Value lookUpVariable(const Token &name, const Binding &binding);
+  void declare(const Binding &binding, Value value);
   ErrorReporter &errorReporter_;
+  GlobalTable globals_;
   EnvPtr globalEnv_;
+  // Environments of callers and enclosing blocks are saved in TempRoots
+  // by executeBlock while env_ points elsewhere.
   EnvPtr env_;
-  LocalMap locals_;
-};
-
-class Return : public std::runtime_error {
-public:
-  Return(std::any value)
-      : std::runtime_error("hack"), value(std::move(value)) {}
-
-  const std::any value;
+  // Locals no closure captures live in stack frames rather than in
+  // Environments, so most calls allocate nothing on the heap.
+  std::unique_ptr<Value[]> stack_;
+  Value *frame_;
+  Value *stackTop_;
+  Value returnValue_;
+  TailCall tailCall_;
 };
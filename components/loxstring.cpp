@@ -0,0 +1,132 @@
+#include "loxstring.h"
+#include "gc.h"
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace {
+// Below this length copying is cheaper than allocating a rope node and
+// flattening it later.
+const size_t MIN_ROPE_LENGTH = 64;
+} // namespace
+
+LoxString *LoxString::allocate(size_t length) {
+  void *storage = ::operator new(sizeof(LoxString) + length);
+  return new (storage) LoxString(length);
+}
+
+StringPtr LoxString::create(std::string_view chars) {
+  size_t size = sizeof(LoxString) + chars.size();
+  gc().reserve(size);
+  LoxString *string = allocate(chars.size());
+  std::memcpy(string->data(), chars.data(), chars.size());
+  gc().track(string, size);
+  return string;
+}
+
+StringPtr concatenate(StringPtr left, StringPtr right) {
+  if (left->length() == 0)
+    return right;
+  if (right->length() == 0)
+    return left;
+  size_t length = left->length() + right->length();
+  // the operands may be referenced from C++ only
+  TempRoots roots(left);
+  roots.add(right);
+  if (length >= MIN_ROPE_LENGTH) {
+    gc().reserve(sizeof(LoxString));
+    LoxString *rope = new LoxString(left, right);
+    gc().track(rope, sizeof(LoxString));
+    return rope;
+  }
+  size_t size = sizeof(LoxString) + length;
+  gc().reserve(size);
+  LoxString *string = LoxString::allocate(length);
+  char *chars = string->data();
+  std::string_view l = left->chars();
+  std::memcpy(chars, l.data(), l.size());
+  std::string_view r = right->chars();
+  std::memcpy(chars + l.size(), r.data(), r.size());
+  gc().track(string, size);
+  return string;
+}
+
+void LoxString::flatten() const {
+  flattened_ = std::make_unique<char[]>(length_);
+  char *out = flattened_.get();
+  // Ropes built in a loop are deeply left-leaning, so walk them with an
+  // explicit stack rather than recursion.
+  std::vector<const LoxString *> pending{this};
+  while (!pending.empty()) {
+    const LoxString *node = pending.back();
+    pending.pop_back();
+    if (node->left_ == nullptr) {
+      std::memcpy(out, node->data_, node->length_);
+      out += node->length_;
+    } else {
+      pending.push_back(node->right_);
+      pending.push_back(node->left_);
+    }
+  }
+  data_ = flattened_.get();
+  // the operands are garbage now unless something else refers to them
+  left_ = nullptr;
+  right_ = nullptr;
+  gc().charge(this, length_);
+}
+
+void LoxString::trace(GC &gc) const {
+  gc.mark(left_);
+  gc.mark(right_);
+}
+
+namespace {
+// Open addressing with linear probing, at most half full. Slots point at
+// the interned strings themselves, whose hash is cached, so a lookup is
+// one hash of `chars` and usually a single probe. Never destroyed:
+// interned strings are referenced until the very end.
+std::vector<LoxString *> &internTable() {
+  static auto &table = *new std::vector<LoxString *>(1024, nullptr);
+  return table;
+}
+
+size_t internedCount = 0;
+
+void insertInterned(std::vector<LoxString *> &table, LoxString *string) {
+  size_t mask = table.size() - 1;
+  size_t i = string->hash() & mask;
+  while (table[i] != nullptr) {
+    i = (i + 1) & mask;
+  }
+  table[i] = string;
+}
+} // namespace
+
+LoxString *intern(std::string_view chars) {
+  std::vector<LoxString *> &table = internTable();
+  size_t hash = std::hash<std::string_view>()(chars);
+  size_t mask = table.size() - 1;
+  for (size_t i = hash & mask; table[i] != nullptr; i = (i + 1) & mask) {
+    if (table[i]->hash_ == hash && table[i]->chars() == chars) {
+      return table[i];
+    }
+  }
+  // Interned strings live for the whole run, outside the GC heap.
+  LoxString *string = LoxString::allocate(chars.size());
+  std::memcpy(string->data(), chars.data(), chars.size());
+  string->interned_ = true;
+  string->hash_ = hash;
+  string->hashed_ = true;
+  if (++internedCount * 2 > table.size()) {
+    std::vector<LoxString *> grown(table.size() * 2, nullptr);
+    for (LoxString *interned : table) {
+      if (interned != nullptr) {
+        insertInterned(grown, interned);
+      }
+    }
+    table = std::move(grown);
+  }
+  insertInterned(table, string);
+  return string;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "object.h"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+class LoxString;
+using StringPtr = LoxString *;
+
+/**
+ * Immutable Lox string. Copying a Value holding one only copies the
+ * pointer; the characters are never duplicated.
+ *
+ * A flat string stores its characters inline, right after the object in
+ * the same allocation, so creating one is a single allocation and reading
+ * it touches a single block. The hash is computed once and cached.
+ *
+ * Concatenating long strings builds a rope: the result just points at
+ * both operands and is flattened into a single buffer the first time its
+ * characters are needed (printing, comparing, hashing). Building a string
+ * piece by piece in a loop is then linear instead of quadratic.
+ **/
+class LoxString : public Object {
+public:
+  static StringPtr create(std::string_view chars);
+  // Flat strings live in storage sized for their characters.
+  static void operator delete(void *ptr) { ::operator delete(ptr); }
+
+  std::string str() const override { return std::string(chars()); }
+  std::string_view chars() const {
+    if (left_ != nullptr)
+      flatten();
+    return std::string_view(data_, length_);
+  }
+  size_t length() const { return length_; }
+  size_t hash() const {
+    if (!hashed_) {
+      hash_ = std::hash<std::string_view>()(chars());
+      hashed_ = true;
+    }
+    return hash_;
+  }
+  bool interned() const { return interned_; }
+  void trace(GC &gc) const override;
+
+private:
+  friend StringPtr concatenate(StringPtr left, StringPtr right);
+  friend LoxString *intern(std::string_view chars);
+
+  // Flat string with room for `length` characters after the object; the
+  // caller copies them in. Not yet handed over to the GC.
+  static LoxString *allocate(size_t length);
+  explicit LoxString(size_t length)
+      : Object(ObjType::STRING), data_(data()), length_(length) {}
+  // the inline characters of a flat string, right after the object
+  char *data() { return reinterpret_cast<char *>(this + 1); }
+  // rope
+  LoxString(StringPtr left, StringPtr right)
+      : Object(ObjType::STRING), data_(nullptr),
+        length_(left->length() + right->length()), left_(left),
+        right_(right) {}
+
+  void flatten() const;
+
+  // inline characters, or flattened_ for a rope once flattened
+  mutable const char *data_;
+  mutable std::unique_ptr<char[]> flattened_;
+  const size_t length_;
+  // operands of an unflattened concatenation, nullptr once flat
+  mutable StringPtr left_ = nullptr;
+  mutable StringPtr right_ = nullptr;
+  mutable size_t hash_ = 0;
+  mutable bool hashed_ = false;
+  bool interned_ = false;
+};
+
+// left + right; long results are ropes, short ones are copied right away.
+StringPtr concatenate(StringPtr left, StringPtr right);
+
+/**
+ * Returns the unique LoxString holding `chars`, creating it on first use.
+ *
+ * The scanner interns identifiers and string literals. Interned strings
+ * are never freed, so they double as symbols: tables keyed by names
+ * (methods, fields, globals) key on the pointer and its cached hash, and
+ * two interned strings are equal only if they are the same object.
+ **/
+LoxString *intern(std::string_view chars);
+
+struct SymbolHash {
+  size_t operator()(const LoxString *symbol) const { return symbol->hash(); }
+};
+
+template <typename T>
+using SymbolMap = std::unordered_map<const LoxString *, T, SymbolHash>;
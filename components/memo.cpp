@@ -0,0 +1,81 @@
+#include "memo.h"
+#include "loxstring.h"
+#include <functional>
+
+MemoConfig &memoConfig() {
+  static MemoConfig config;
+  return config;
+}
+
+MemoStats &memoStats() {
+  static MemoStats stats;
+  return stats;
+}
+
+bool MemoTable::cacheable(Args args) {
+  for (const Value &arg : args) {
+    if (arg.isObj() && !arg.isString()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const Value *MemoTable::find(Args args) const {
+  auto entry = entries_.find(args);
+  if (entry == entries_.end()) {
+    memoStats().misses++;
+    return nullptr;
+  }
+  memoStats().hits++;
+  return &entry->second;
+}
+
+void MemoTable::insert(Args args, const Value &result) {
+  if (entries_.size() >= memoConfig().maxEntries) {
+    entries_.clear();
+  }
+  entries_.emplace(std::vector<Value>(args.begin(), args.end()), result);
+}
+
+void MemoTable::trace(GC &gc) const {
+  for (const auto &[key, result] : entries_) {
+    for (const Value &arg : key) {
+      gc.mark(arg);
+    }
+    gc.mark(result);
+  }
+}
+
+size_t MemoTable::KeyHash::operator()(Args key) const {
+  size_t hash = key.size();
+  for (const Value &arg : key) {
+    size_t h;
+    if (arg.isString()) {
+      // equal strings need not be the same object
+      h = arg.as<LoxString>()->hash();
+    } else if (arg.isNumber()) {
+      h = std::hash<double>()(arg.asNumber());
+    } else {
+      h = arg.isNil() ? 1 : arg.asBool() ? 2 : 3;
+    }
+    hash = hash * 31 + h;
+  }
+  return hash;
+}
+
+bool MemoTable::KeyEqual::operator()(Args a, Args b) const {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].isString() && b[i].isString()) {
+      if (a[i].as<LoxString>()->chars() != b[i].as<LoxString>()->chars()) {
+        return false;
+      }
+    } else if (!a[i].sameBits(b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
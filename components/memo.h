@@ -0,0 +1,61 @@
+#pragma once
+
+#include "callable.h"
+#include "gc.h"
+#include "value.h"
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Result caches for functions the Resolver proved pure (FunStmt::pure):
+ * they only read their own locals and call pure functions, so the same
+ * arguments always give the same result.
+ *
+ * Memoization is opt-in (--memoize). Each LoxFunction gets its own
+ * table, keyed by argument values; only numbers, booleans, nil and
+ * strings make keys, since other objects could change between calls. A
+ * full table is cleared rather than evicting entry by entry. Calls made
+ * in tail position bypass the cache so they keep running in constant
+ * stack.
+ *
+ * The Resolver only sees one program at a time: in the REPL, redefining
+ * a function an earlier pure one calls is not noticed. The VM has its own
+ * function objects and doesn't memoize.
+ **/
+struct MemoConfig {
+  bool enabled = false;
+  // entries per function
+  size_t maxEntries = 4096;
+};
+
+struct MemoStats {
+  size_t hits = 0;
+  size_t misses = 0;
+};
+
+MemoConfig &memoConfig();
+MemoStats &memoStats();
+
+class MemoTable {
+public:
+  // Whether `args` can be used as a key.
+  static bool cacheable(Args args);
+  // Counts a hit or a miss; nullptr on a miss.
+  const Value *find(Args args) const;
+  void insert(Args args, const Value &result);
+  void trace(GC &gc) const;
+
+private:
+  // transparent, so lookups don't copy the arguments into a key
+  struct KeyHash {
+    using is_transparent = void;
+    size_t operator()(Args key) const;
+  };
+  struct KeyEqual {
+    using is_transparent = void;
+    bool operator()(Args a, Args b) const;
+  };
+
+  std::unordered_map<std::vector<Value>, Value, KeyHash, KeyEqual> entries_;
+};
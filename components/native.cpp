@@ -1,9 +1,17 @@
 #include "native.h"
+#include "gc.h"
 #include <chrono>
 
-std::any LoxClock::call(Interpreter &ip, const std::vector<std::any> &args) {
+namespace {
+// returns seconds since epoch
+Value clockNative(Args) {
   const auto now = std::chrono::system_clock::now();
   return static_cast<double>(
       std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch())
           .count());
 }
+} // namespace
+
+void defineNatives(GlobalTable &globals) {
+  globals.define("clock", makeObj<LoxNative>("clock", 0, clockNative));
+}
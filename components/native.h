@@ -1,6 +1,8 @@
 #pragma once
 
 #include "callable.h"
+#include "globals.h"
+#include <string>
 
 /**
  * Lox functions that are not implemented with Lox itself,
@@ -8,11 +10,27 @@
  *
  * These functions are to be exposed to Lox users via interpreter
  * by being injected into the global environment at startup.
+ * They don't depend on the interpreter, so every execution engine
+ * can call them.
  **/
 
-class LoxClock : public Callable {
+class LoxNative : public Callable {
 public:
-  // returns seconds since epoch
-  std::any call(Interpreter &ip, const std::vector<std::any> &args) override;
-  int arity() const override { return 0; };
+  using NativeFn = Value (*)(Args args);
+  LoxNative(const std::string &name, int arity, NativeFn fn)
+      : Callable(ObjType::NATIVE), name_(name), arity_(arity), fn_(fn) {}
+  Value call(Interpreter &, Args args) override { return fn_(args); }
+  Value invoke(Args args) { return fn_(args); }
+  int arity() const override { return arity_; };
+  std::string str() const override {
+    return "<Native function: " + name_ + ">";
+  }
+
+private:
+  const std::string name_;
+  const int arity_;
+  const NativeFn fn_;
 };
+
+// Defines all native functions in `globals`.
+void defineNatives(GlobalTable &globals);
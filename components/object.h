@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class GC;
+
+/**
+ * Base class of every Lox value that lives on the heap (strings,
+ * functions, classes, instances, natives and environments).
+ *
+ * Objects are owned by the tracing garbage collector (see gc.h): every
+ * object allocated with makeObj is linked into the GC's heap list and is
+ * freed by a collection once no root reaches it any more. Plain Object
+ * pointers are therefore non-owning.
+ **/
+
+enum class ObjType : uint8_t {
+  STRING,
+  FUNCTION,
+  CLASS,
+  INSTANCE,
+  NATIVE,
+  ENVIRONMENT,
+
+  // Bytecode VM only.
+  VM_FUNCTION,
+  VM_CLOSURE,
+  VM_UPVALUE,
+  VM_CLASS,
+  VM_INSTANCE,
+  VM_BOUND_METHOD,
+};
+
+class Object {
+public:
+  explicit Object(ObjType type) : type(type) {}
+  Object(const Object &) = delete;
+  Object &operator=(const Object &) = delete;
+  virtual ~Object() = default;
+  virtual std::string str() const = 0;
+  // Marks every object this one refers to.
+  virtual void trace(GC &) const {}
+
+  const ObjType type;
+
+private:
+  friend class GC;
+  bool marked_ = false;
+  // bytes charged to the heap for this object
+  uint32_t size_ = 0;
+  // next object in the GC's list of all allocated objects
+  Object *next_ = nullptr;
+};
@@ -0,0 +1,399 @@
+#include "optimizer.h"
+#include "../utils/value_util.h"
+#include <string>
+
+namespace {
+const Literal *asLiteral(ExprPtr expr) {
+  return dynamic_cast<const Literal *>(expr);
+}
+
+// Folds `left op right`, or returns false if the operation isn't one we
+// can evaluate ahead of time (including ones that would throw).
+bool foldBinary(TokenType op, const Value &left, const Value &right,
+                Value &result) {
+  if (op == TokenType::EQUAL_EQUAL) {
+    result = valueEqual(left, right);
+    return true;
+  }
+  if (op == TokenType::BANG_EQUAL) {
+    result = !valueEqual(left, right);
+    return true;
+  }
+  if (op == TokenType::PLUS && left.isString() && right.isString()) {
+    // literals must not be collected, and interned strings never are
+    result = intern(std::string(left.as<LoxString>()->chars()) +
+                    std::string(right.as<LoxString>()->chars()));
+    return true;
+  }
+  if (!left.isNumber() || !right.isNumber()) {
+    return false;
+  }
+  double a = left.asNumber();
+  double b = right.asNumber();
+  switch (op) {
+  case TokenType::PLUS:
+    result = a + b;
+    return true;
+  case TokenType::MINUS:
+    result = a - b;
+    return true;
+  case TokenType::STAR:
+    result = a * b;
+    return true;
+  case TokenType::SLASH:
+    result = a / b;
+    return true;
+  case TokenType::GREATER:
+    result = a > b;
+    return true;
+  case TokenType::GREATER_EQUAL:
+    result = a >= b;
+    return true;
+  case TokenType::LESS:
+    result = a < b;
+    return true;
+  case TokenType::LESS_EQUAL:
+    result = a <= b;
+    return true;
+  default:
+    return false;
+  }
+}
+
+// The name a declaration binds if removing it is safe when nothing refers
+// to that name: uncaptured locals with a constant value and local
+// functions. Globals may be used by code that isn't written yet.
+const LoxString *removableIfUnused(StmtPtr stmt) {
+  if (const auto *decl = dynamic_cast<const VarDecl *>(stmt)) {
+    bool constant =
+        decl->initializer == nullptr || asLiteral(decl->initializer);
+    if (decl->binding.type == BindingType::LOCAL && constant) {
+      return decl->name.symbol();
+    }
+  } else if (const auto *fun = dynamic_cast<const FunStmt *>(stmt)) {
+    if (fun->binding.type == BindingType::LOCAL) {
+      return fun->name.symbol();
+    }
+  }
+  return nullptr;
+}
+} // namespace
+
+ExprVisitorResT Optimizer::visitBinaryExpr(const Binary &expr) {
+  ExprPtr left = optimize(expr.left);
+  ExprPtr right = optimize(expr.right);
+  const Literal *a = asLiteral(left);
+  const Literal *b = asLiteral(right);
+  Value folded;
+  if (a != nullptr && b != nullptr &&
+      foldBinary(expr.op.type, a->value, b->value, folded)) {
+    expr_ = arena_.make<Literal>(folded);
+  } else if (left != expr.left || right != expr.right) {
+    expr_ = arena_.make<Binary>(left, expr.op, right);
+  } else {
+    expr_ = &expr;
+  }
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Optimizer::visitGroupingExpr(const Grouping &expr) {
+  // only the parser cares about parentheses
+  expr_ = optimize(expr.expr);
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Optimizer::visitLiteralExpr(const Literal &expr) {
+  expr_ = &expr;
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Optimizer::visitUnaryExpr(const Unary &expr) {
+  ExprPtr right = optimize(expr.right);
+  const Literal *literal = asLiteral(right);
+  if (literal != nullptr && expr.op.type == TokenType::BANG) {
+    expr_ = arena_.make<Literal>(Value(!isTruthy(literal->value)));
+  } else if (literal != nullptr && expr.op.type == TokenType::MINUS &&
+             literal->value.isNumber()) {
+    expr_ = arena_.make<Literal>(Value(-literal->value.asNumber()));
+  } else if (right != expr.right) {
+    expr_ = arena_.make<Unary>(expr.op, right);
+  } else {
+    expr_ = &expr;
+  }
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Optimizer::visitVariableExpr(const Variable &expr) {
+  uses_[expr.name.symbol()]++;
+  expr_ = &expr;
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Optimizer::visitAssignmentExpr(const Assignment &expr) {
+  uses_[expr.name.symbol()]++;
+  ExprPtr value = optimize(expr.value);
+  if (value == expr.value) {
+    expr_ = &expr;
+    return ExprVisitorResT();
+  }
+  Assignment *assignment = arena_.make<Assignment>(expr.name, value);
+  assignment->binding = expr.binding;
+  expr_ = assignment;
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Optimizer::visitLogicalExpr(const Logical &expr) {
+  ExprPtr left = optimize(expr.left);
+  if (const Literal *literal = asLiteral(left)) {
+    // the left operand decides whether the right one is the result
+    bool truthy = isTruthy(literal->value);
+    bool shortCircuits = expr.op.type == TokenType::OR ? truthy : !truthy;
+    expr_ = shortCircuits ? left : optimize(expr.right);
+    return ExprVisitorResT();
+  }
+  ExprPtr right = optimize(expr.right);
+  if (left != expr.left || right != expr.right) {
+    expr_ = arena_.make<Logical>(expr.op, left, right);
+  } else {
+    expr_ = &expr;
+  }
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Optimizer::visitCallExpr(const Call &expr) {
+  ExprPtr callee = optimize(expr.callee);
+  bool changed = callee != expr.callee;
+  std::vector<ExprPtr> arguments;
+  for (ExprPtr argument : expr.arguments) {
+    arguments.push_back(optimize(argument));
+    changed = changed || arguments.back() != argument;
+  }
+  expr_ = changed ? arena_.make<Call>(callee, expr.paren, std::move(arguments))
+                  : &expr;
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Optimizer::visitGetExpr(const Get &expr) {
+  ExprPtr object = optimize(expr.object);
+  expr_ = object != expr.object ? arena_.make<Get>(object, expr.name) : &expr;
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Optimizer::visitSetExpr(const Set &expr) {
+  ExprPtr object = optimize(expr.object);
+  ExprPtr value = optimize(expr.value);
+  if (object != expr.object || value != expr.value) {
+    expr_ = arena_.make<Set>(object, expr.name, value);
+  } else {
+    expr_ = &expr;
+  }
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Optimizer::visitThisExpr(const This &expr) {
+  expr_ = &expr;
+  return ExprVisitorResT();
+}
+
+ExprVisitorResT Optimizer::visitSuperExpr(const Super &expr) {
+  expr_ = &expr;
+  return ExprVisitorResT();
+}
+
+StmtVisitorResT Optimizer::visitPrintStmt(const PrintStmt &stmt) {
+  ExprPtr expr = optimize(stmt.expr);
+  stmt_ = expr != stmt.expr ? arena_.make<PrintStmt>(expr) : &stmt;
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Optimizer::visitExpressionStmt(const ExpressionStmt &stmt) {
+  ExprPtr expr = optimize(stmt.expr);
+  if (asLiteral(expr) != nullptr) {
+    stmt_ = nullptr;
+  } else {
+    stmt_ = expr != stmt.expr ? arena_.make<ExpressionStmt>(expr) : &stmt;
+  }
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Optimizer::visitVarDecl(const VarDecl &stmt) {
+  if (stmt.initializer == nullptr) {
+    stmt_ = &stmt;
+    return StmtVisitorResT();
+  }
+  ExprPtr initializer = optimize(stmt.initializer);
+  if (initializer == stmt.initializer) {
+    stmt_ = &stmt;
+    return StmtVisitorResT();
+  }
+  VarDecl *decl = arena_.make<VarDecl>(stmt.name, initializer);
+  decl->binding = stmt.binding;
+  stmt_ = decl;
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Optimizer::visitBlock(const Block &block) {
+  std::vector<StmtPtr> stmts = optimize(block.stmts);
+  if (stmts.empty()) {
+    stmt_ = nullptr;
+    return StmtVisitorResT();
+  }
+  if (stmts == block.stmts) {
+    stmt_ = &block;
+    return StmtVisitorResT();
+  }
+  Block *optimized = arena_.make<Block>(std::move(stmts));
+  optimized->needsEnvironment = block.needsEnvironment;
+  stmt_ = optimized;
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Optimizer::visitIfStmt(const IfStmt &stmt) {
+  ExprPtr condition = optimize(stmt.condition);
+  if (const Literal *literal = asLiteral(condition)) {
+    if (isTruthy(literal->value)) {
+      stmt_ = optimize(stmt.thenStmt);
+    } else {
+      stmt_ = stmt.elseStmt != nullptr ? optimize(stmt.elseStmt) : nullptr;
+    }
+    return StmtVisitorResT();
+  }
+  StmtPtr thenStmt = orEmpty(optimize(stmt.thenStmt));
+  StmtPtr elseStmt = stmt.elseStmt != nullptr ? optimize(stmt.elseStmt)
+                                              : nullptr;
+  if (condition != stmt.condition || thenStmt != stmt.thenStmt ||
+      elseStmt != stmt.elseStmt) {
+    stmt_ = arena_.make<IfStmt>(condition, thenStmt, elseStmt);
+  } else {
+    stmt_ = &stmt;
+  }
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Optimizer::visitWhileStmt(const WhileStmt &stmt) {
+  ExprPtr condition = optimize(stmt.condition);
+  const Literal *literal = asLiteral(condition);
+  if (literal != nullptr && !isTruthy(literal->value)) {
+    stmt_ = nullptr;
+    return StmtVisitorResT();
+  }
+  StmtPtr body = orEmpty(optimize(stmt.stmt));
+  if (condition != stmt.condition || body != stmt.stmt) {
+    stmt_ = arena_.make<WhileStmt>(condition, body);
+  } else {
+    stmt_ = &stmt;
+  }
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Optimizer::visitFunStmt(const FunStmt &stmt) {
+  stmt_ = optimizeFun(stmt);
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Optimizer::visitReturnStmt(const ReturnStmt &stmt) {
+  if (stmt.value == nullptr) {
+    stmt_ = &stmt;
+    return StmtVisitorResT();
+  }
+  ExprPtr value = optimize(stmt.value);
+  if (value == stmt.value) {
+    stmt_ = &stmt;
+    return StmtVisitorResT();
+  }
+  ReturnStmt *ret = arena_.make<ReturnStmt>(stmt.keyword, value);
+  // folding a call's arguments leaves it a call
+  ret->tailCall = stmt.tailCall;
+  stmt_ = ret;
+  return StmtVisitorResT();
+}
+
+StmtVisitorResT Optimizer::visitClassStmt(const ClassStmt &stmt) {
+  if (stmt.super != nullptr) {
+    optimize(stmt.super);
+  }
+  bool changed = false;
+  std::vector<FunStmtPtr> methods;
+  for (FunStmtPtr method : stmt.methods) {
+    methods.push_back(optimizeFun(*method));
+    changed = changed || methods.back() != method;
+  }
+  if (!changed) {
+    stmt_ = &stmt;
+    return StmtVisitorResT();
+  }
+  ClassStmt *klass =
+      arena_.make<ClassStmt>(stmt.name, stmt.super, std::move(methods));
+  klass->binding = stmt.binding;
+  stmt_ = klass;
+  return StmtVisitorResT();
+}
+
+std::vector<StmtPtr> Optimizer::optimize(const std::vector<StmtPtr> &stmts) {
+  struct Candidate {
+    size_t index;
+    const LoxString *name;
+    int uses;
+  };
+  std::vector<StmtPtr> result;
+  std::vector<Candidate> candidates;
+  for (StmtPtr stmt : stmts) {
+    StmtPtr optimized = optimize(stmt);
+    if (optimized == nullptr) {
+      continue;
+    }
+    if (const LoxString *name = removableIfUnused(optimized)) {
+      candidates.push_back(Candidate{result.size(), name, uses_[name]});
+    }
+    result.push_back(optimized);
+    if (dynamic_cast<const ReturnStmt *>(optimized) != nullptr) {
+      // nothing after it can run
+      break;
+    }
+  }
+
+  // A local can only be referred to later in its own block, so if the
+  // count didn't change since its declaration nothing reads it.
+  std::vector<bool> unused(result.size(), false);
+  for (const Candidate &candidate : candidates) {
+    unused[candidate.index] = uses_[candidate.name] == candidate.uses;
+  }
+  std::vector<StmtPtr> live;
+  for (size_t i = 0; i < result.size(); i++) {
+    if (!unused[i]) {
+      live.push_back(result[i]);
+    }
+  }
+  return live;
+}
+
+ExprPtr Optimizer::optimize(ExprPtr expr) {
+  expr->accept(*this);
+  return expr_;
+}
+
+StmtPtr Optimizer::optimize(StmtPtr stmt) {
+  stmt->accept(*this);
+  return stmt_;
+}
+
+FunStmtPtr Optimizer::optimizeFun(const FunStmt &fun) {
+  std::vector<StmtPtr> body = optimize(fun.body);
+  if (body == fun.body) {
+    return &fun;
+  }
+  FunStmt *optimized = arena_.make<FunStmt>(fun.name, fun.params, body);
+  optimized->binding = fun.binding;
+  optimized->frameSize = fun.frameSize;
+  optimized->needsEnvironment = fun.needsEnvironment;
+  optimized->capturedParams = fun.capturedParams;
+  optimized->pure = fun.pure;
+  return optimized;
+}
+
+StmtPtr Optimizer::orEmpty(StmtPtr stmt) {
+  if (stmt != nullptr) {
+    return stmt;
+  }
+  return arena_.make<Block>(std::vector<StmtPtr>());
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "expr.h"
+#include "loxstring.h"
+#include "program.h"
+#include "stmt.h"
+#include <vector>
+
+/**
+ * Optional pass over a resolved program, run before it executes
+ * (--optimize).
+ *
+ * Folds operators whose operands are literals and drops parentheses,
+ * prunes if and while statements with a constant condition and the
+ * statements after a return, and removes locals initialized to a
+ * constant (and local functions) that nothing refers to. Operations that
+ * would fail at runtime are left alone so they still report their error.
+ *
+ * Running after the Resolver means static errors are reported for the
+ * whole program; every rewrite keeps the bindings valid: it only removes
+ * code that never runs or uncaptured locals nothing reads.
+ *
+ * Nodes are immutable, so changed nodes are rebuilt in the Program's
+ * arena, carrying over what the Resolver recorded on them.
+ **/
+class Optimizer : public ExprVisitor, public StmtVisitor {
+public:
+  explicit Optimizer(AstArena &arena) : arena_(arena) {}
+  ExprVisitorResT visitBinaryExpr(const Binary &expr) override;
+  ExprVisitorResT visitGroupingExpr(const Grouping &expr) override;
+  ExprVisitorResT visitLiteralExpr(const Literal &expr) override;
+  ExprVisitorResT visitUnaryExpr(const Unary &expr) override;
+  ExprVisitorResT visitVariableExpr(const Variable &expr) override;
+  ExprVisitorResT visitAssignmentExpr(const Assignment &expr) override;
+  ExprVisitorResT visitLogicalExpr(const Logical &expr) override;
+  ExprVisitorResT visitCallExpr(const Call &expr) override;
+  ExprVisitorResT visitGetExpr(const Get &expr) override;
+  ExprVisitorResT visitSetExpr(const Set &expr) override;
+  ExprVisitorResT visitThisExpr(const This &expr) override;
+  ExprVisitorResT visitSuperExpr(const Super &expr) override;
+  StmtVisitorResT visitPrintStmt(const PrintStmt &stmt) override;
+  StmtVisitorResT visitExpressionStmt(const ExpressionStmt &stmt) override;
+  StmtVisitorResT visitVarDecl(const VarDecl &stmt) override;
+  StmtVisitorResT visitBlock(const Block &block) override;
+  StmtVisitorResT visitIfStmt(const IfStmt &stmt) override;
+  StmtVisitorResT visitWhileStmt(const WhileStmt &stmt) override;
+  StmtVisitorResT visitFunStmt(const FunStmt &stmt) override;
+  StmtVisitorResT visitReturnStmt(const ReturnStmt &stmt) override;
+  StmtVisitorResT visitClassStmt(const ClassStmt &stmt) override;
+  std::vector<StmtPtr> optimize(const std::vector<StmtPtr> &stmts);
+
+private:
+  ExprPtr optimize(ExprPtr expr);
+  // nullptr if the statement was removed
+  StmtPtr optimize(StmtPtr stmt);
+  FunStmtPtr optimizeFun(const FunStmt &fun);
+  // Where a removed statement is still syntactically required.
+  StmtPtr orEmpty(StmtPtr stmt);
+
+  AstArena &arena_;
+  // how often each name has been referred to so far, to find unused
+  // locals
+  SymbolMap<int> uses_;
+  // result of the last visited node
+  ExprPtr expr_ = nullptr;
+  StmtPtr stmt_ = nullptr;
+};
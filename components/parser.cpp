@@ -1,24 +1,70 @@
 #include "parser.h"
 #include "expr.h"
+#include <array>
 #include <iostream>
 
 namespace {
 const int MAX_PARAM_OR_ARG_NUM = 255;
 }
 
+/**
+ * One ParseRule per token type: how to parse an expression starting with
+ * the token (prefix), how to extend an expression the token follows
+ * (infix), and how tightly that infix operator binds. Tokens that can't
+ * appear in an expression keep the empty rule.
+ **/
+constexpr std::array<Parser::ParseRule, Parser::TOKEN_TYPES>
+Parser::buildRules() {
+  std::array<ParseRule, TOKEN_TYPES> rules{};
+  auto set = [&rules](TokenType type, PrefixFn prefix, InfixFn infix,
+                      Precedence precedence) {
+    rules[static_cast<size_t>(type)] = ParseRule{prefix, infix, precedence};
+  };
+  using P = Precedence;
+  using T = TokenType;
+  set(T::LEFT_PAREN, &Parser::grouping, &Parser::call, P::CALL);
+  set(T::DOT, nullptr, &Parser::dot, P::CALL);
+  set(T::MINUS, &Parser::unary, &Parser::binary, P::TERM);
+  set(T::PLUS, nullptr, &Parser::binary, P::TERM);
+  set(T::SLASH, nullptr, &Parser::binary, P::FACTOR);
+  set(T::STAR, nullptr, &Parser::binary, P::FACTOR);
+  set(T::BANG, &Parser::unary, nullptr, P::NONE);
+  set(T::BANG_EQUAL, nullptr, &Parser::binary, P::EQUALITY);
+  set(T::EQUAL_EQUAL, nullptr, &Parser::binary, P::EQUALITY);
+  set(T::GREATER, nullptr, &Parser::binary, P::COMPARISON);
+  set(T::GREATER_EQUAL, nullptr, &Parser::binary, P::COMPARISON);
+  set(T::LESS, nullptr, &Parser::binary, P::COMPARISON);
+  set(T::LESS_EQUAL, nullptr, &Parser::binary, P::COMPARISON);
+  set(T::AND, nullptr, &Parser::logical, P::AND);
+  set(T::OR, nullptr, &Parser::logical, P::OR);
+  set(T::IDENTIFIER, &Parser::variable, nullptr, P::NONE);
+  set(T::STRING, &Parser::literal, nullptr, P::NONE);
+  set(T::NUMBER, &Parser::literal, nullptr, P::NONE);
+  set(T::FALSE, &Parser::literal, nullptr, P::NONE);
+  set(T::TRUE, &Parser::literal, nullptr, P::NONE);
+  set(T::NIL, &Parser::literal, nullptr, P::NONE);
+  set(T::THIS, &Parser::thisExpr, nullptr, P::NONE);
+  set(T::SUPER, &Parser::superExpr, nullptr, P::NONE);
+  return rules;
+}
+
+const Parser::ParseRule &Parser::rule(TokenType type) {
+  static constexpr std::array<ParseRule, TOKEN_TYPES> RULES = buildRules();
+  return RULES[static_cast<size_t>(type)];
+}
+
 ExprPtr Parser::expression() { return assignment(); }
 
 ExprPtr Parser::assignment() {
-  ExprPtr expr = orExpr();
+  ExprPtr expr = parsePrecedence(Precedence::OR);
 
-  if (match({TokenType::EQUAL})) {
-    Token equals = previous();
+  if (match(TokenType::EQUAL)) {
+    const Token &equals = previous();
     ExprPtr value = assignment();
-    if (Variable *v = dynamic_cast<Variable *>(expr.get())) {
-      return std::make_unique<Assignment>(v->name, std::move(value));
-    } else if (Get *g = dynamic_cast<Get *>(expr.get())) {
-      return std::make_unique<Set>(std::move(g->object), g->name,
-                                   std::move(value));
+    if (const Variable *v = dynamic_cast<const Variable *>(expr)) {
+      return arena_.make<Assignment>(v->name, value);
+    } else if (const Get *g = dynamic_cast<const Get *>(expr)) {
+      return arena_.make<Set>(g->object, g->name, value);
     }
     errorReporter_.report(equals.line, " = ", "Invalid assignment target.");
   }
@@ -26,109 +72,78 @@ ExprPtr Parser::assignment() {
   return expr;
 }
 
-ExprPtr Parser::orExpr() {
-  ExprPtr expr = andExpr();
-  while (match({TokenType::OR})) {
-    Token op = previous();
-    ExprPtr right = andExpr();
-    expr = std::make_unique<Logical>(op, std::move(expr), std::move(right));
+ExprPtr Parser::parsePrecedence(Precedence precedence) {
+  PrefixFn prefix = rule(peek().type).prefix;
+  // throw away un-recognized stuff
+  advance();
+  if (prefix == nullptr) {
+    throw error(previous(), "Expect expression.");
   }
+  ExprPtr expr = (this->*prefix)();
 
-  return expr;
-}
-
-ExprPtr Parser::andExpr() {
-  ExprPtr expr = equality();
-  while (match({TokenType::AND})) {
-    Token op = previous();
-    ExprPtr right = equality();
-    expr = std::make_unique<Logical>(op, std::move(expr), std::move(right));
+  while (precedence <= rule(peek().type).precedence) {
+    InfixFn infix = rule(advance().type).infix;
+    expr = (this->*infix)(expr);
   }
   return expr;
 }
 
-ExprPtr Parser::equality() {
-  ExprPtr expr = comparison();
-
-  while (match({TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL})) {
-    Token op = previous();
-    ExprPtr right = comparison();
-    expr = std::make_unique<Binary>(std::move(expr), op, std::move(right));
+ExprPtr Parser::literal() {
+  switch (previous().type) {
+  case TokenType::FALSE:
+    return arena_.make<Literal>(false);
+  case TokenType::TRUE:
+    return arena_.make<Literal>(true);
+  case TokenType::NIL:
+    return arena_.make<Literal>(Value());
+  default:
+    return arena_.make<Literal>(previous().literal);
   }
-
-  return expr;
 }
 
-bool Parser::match(const std::vector<TokenType> &&types) {
-  for (const auto &type : types) {
-    if (check(type)) {
-      advance();
-      return true;
-    }
-  }
+ExprPtr Parser::variable() { return arena_.make<Variable>(previous()); }
 
-  return false;
-}
+ExprPtr Parser::thisExpr() { return arena_.make<This>(previous()); }
 
-ExprPtr Parser::comparison() {
-  ExprPtr expr = term();
-  while (match({TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS,
-                TokenType::LESS_EQUAL})) {
-    Token op = previous();
-    ExprPtr right = term();
-    expr = std::make_unique<Binary>(std::move(expr), op, std::move(right));
-  }
-  return expr;
+ExprPtr Parser::superExpr() {
+  const Token &keyword = previous();
+  consume(TokenType::DOT, "Expect '.' after 'super'.");
+  const Token &method =
+      consume(TokenType::IDENTIFIER, "Expect superclass method name.");
+  return arena_.make<Super>(keyword, method);
 }
 
-ExprPtr Parser::term() {
-  ExprPtr expr = factor();
-  while (match({TokenType::MINUS, TokenType::PLUS})) {
-    Token op = previous();
-    ExprPtr right = factor();
-    expr = std::make_unique<Binary>(std::move(expr), op, std::move(right));
-  }
-  return expr;
-}
-
-ExprPtr Parser::factor() {
-  ExprPtr expr = unary();
-
-  while (match({TokenType::SLASH, TokenType::STAR})) {
-    Token op = previous();
-    ExprPtr right = unary();
-    expr = std::make_unique<Binary>(std::move(expr), op, std::move(right));
-  }
-  return expr;
+ExprPtr Parser::grouping() {
+  ExprPtr expr = expression();
+  consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
+  return arena_.make<Grouping>(expr);
 }
 
 ExprPtr Parser::unary() {
-  if (match({TokenType::BANG, TokenType::MINUS})) {
-    Token op = previous();
-    ExprPtr right = unary();
-    return std::make_unique<Unary>(op, std::move(right));
-  }
+  const Token &op = previous();
+  ExprPtr right = parsePrecedence(Precedence::UNARY);
+  return arena_.make<Unary>(op, right);
+}
 
-  return call();
+ExprPtr Parser::binary(ExprPtr left) {
+  const Token &op = previous();
+  // operators are left-associative: the right operand stops at the next
+  // operator of the same precedence
+  auto next = static_cast<Precedence>(
+      static_cast<uint8_t>(rule(op.type).precedence) + 1);
+  ExprPtr right = parsePrecedence(next);
+  return arena_.make<Binary>(left, op, right);
 }
 
-ExprPtr Parser::call() {
-  ExprPtr expr = primary();
-  while (true) {
-    if (match({TokenType::LEFT_PAREN})) {
-      expr = finishCall(std::move(expr));
-    } else if (match({TokenType::DOT})) {
-      Token name =
-          consume(TokenType::IDENTIFIER, "Expect property name after '.'.");
-      expr = std::make_unique<Get>(std::move(expr), name);
-    } else {
-      break;
-    }
-  }
-  return expr;
+ExprPtr Parser::logical(ExprPtr left) {
+  const Token &op = previous();
+  auto next = static_cast<Precedence>(
+      static_cast<uint8_t>(rule(op.type).precedence) + 1);
+  ExprPtr right = parsePrecedence(next);
+  return arena_.make<Logical>(op, left, right);
 }
 
-ExprPtr Parser::finishCall(ExprPtr expr) {
+ExprPtr Parser::call(ExprPtr callee) {
   std::vector<ExprPtr> args;
   if (!check(TokenType::RIGHT_PAREN)) {
     do {
@@ -137,56 +152,23 @@ ExprPtr Parser::finishCall(ExprPtr expr) {
                           std::to_string(MAX_PARAM_OR_ARG_NUM) + " arguments.");
       }
       args.push_back(expression());
-    } while (match({TokenType::COMMA}));
+    } while (match(TokenType::COMMA));
   }
 
-  Token paren = consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
+  const Token &paren =
+      consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
 
-  return std::make_unique<Call>(std::move(expr), paren, std::move(args));
+  return arena_.make<Call>(callee, paren, std::move(args));
 }
 
-ExprPtr Parser::primary() {
-  if (match({TokenType::FALSE})) {
-    return std::make_unique<Literal>(false);
-  }
-  if (match({TokenType::TRUE})) {
-    return std::make_unique<Literal>(true);
-  }
-  if (match({TokenType::NIL})) {
-    return std::make_unique<Literal>(std::any());
-  }
-
-  if (match({TokenType::NUMBER, TokenType::STRING})) {
-    return std::make_unique<Literal>(previous().literal);
-  }
-
-  if (match({TokenType::SUPER})) {
-    Token keyword = previous();
-    consume(TokenType::DOT, "Expect '.' after 'super'.");
-    Token method =
-        consume(TokenType::IDENTIFIER, "Expect superclass method name.");
-    return std::make_unique<Super>(keyword, method);
-  }
-
-  if (match({TokenType::THIS}))
-    return std::make_unique<This>(previous());
-
-  if (match({TokenType::IDENTIFIER})) {
-    return std::make_unique<Variable>(previous());
-  }
-
-  if (match({TokenType::LEFT_PAREN})) {
-    ExprPtr expr = expression();
-    consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
-    return std::make_unique<Grouping>(std::move(expr));
-  }
-
-  // throw away un-recognized stuff
-  advance();
-  throw error(previous(), "Expect expression.");
+ExprPtr Parser::dot(ExprPtr object) {
+  const Token &name =
+      consume(TokenType::IDENTIFIER, "Expect property name after '.'.");
+  return arena_.make<Get>(object, name);
 }
 
-Token Parser::consume(const TokenType type, const std::string &msg) {
+const Token &Parser::consume(const TokenType type,
+                              const std::string &msg) {
   if (check(type)) {
     return advance();
   }
@@ -198,7 +180,7 @@ ParseError *Parser::error(const Token &token, const std::string &msg) {
   if (token.type == TokenType::EOF_) {
     errorReporter_.report(token.line, " at end", msg);
   } else {
-    errorReporter_.report(token.line, " at '" + token.lexeme + "'", msg);
+    errorReporter_.report(token.line, " at '" + std::string(token.lexeme) + "'", msg);
   }
 
   return new ParseError();
@@ -238,11 +220,11 @@ void Parser::synchronize() {
 // }
 StmtPtr Parser::declaration() {
   try {
-    if (match({TokenType::CLASS}))
+    if (match(TokenType::CLASS))
       return classDeclaration();
-    if (match({TokenType::FUN}))
+    if (match(TokenType::FUN))
       return funStatement("function");
-    if (match({TokenType::VAR}))
+    if (match(TokenType::VAR))
       return varStatement();
 
     return statement();
@@ -253,12 +235,12 @@ StmtPtr Parser::declaration() {
 }
 
 StmtPtr Parser::classDeclaration() {
-  Token name = consume(TokenType::IDENTIFIER, "Expect class name.");
+  const Token &name = consume(TokenType::IDENTIFIER, "Expect class name.");
 
   VariablePtr super = nullptr;
-  if (match({TokenType::LESS})) {
+  if (match(TokenType::LESS)) {
     consume(TokenType::IDENTIFIER, "Expect superclass name.");
-    super = std::make_unique<Variable>(previous());
+    super = arena_.make<Variable>(previous());
   }
 
   consume(TokenType::LEFT_BRACE, "Expect '{' before class body.");
@@ -269,12 +251,12 @@ StmtPtr Parser::classDeclaration() {
 
   consume(TokenType::RIGHT_BRACE, "Expect '}' after class body.");
 
-  return std::make_unique<ClassStmt>(name, std::move(super),
-                                     std::move(methods));
+  return arena_.make<ClassStmt>(name, super, std::move(methods));
 }
 
 FunStmtPtr Parser::funStatement(const std::string &kind) {
-  Token name = consume(TokenType::IDENTIFIER, "Expect " + kind + " name.");
+  const Token &name =
+      consume(TokenType::IDENTIFIER, "Expect " + kind + " name.");
   consume(TokenType::LEFT_PAREN, "Expect '(' after " + kind + " name.");
   std::vector<Token> params;
   if (!check(TokenType::RIGHT_PAREN)) {
@@ -287,41 +269,41 @@ FunStmtPtr Parser::funStatement(const std::string &kind) {
 
       params.push_back(
           consume(TokenType::IDENTIFIER, "Expect parameter name."));
-    } while (match({TokenType::COMMA}));
+    } while (match(TokenType::COMMA));
   }
   consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters.");
   consume(TokenType::LEFT_BRACE, "Expect '{' before " + kind + " body.");
   auto body = block();
-  return std::make_unique<FunStmt>(name, std::move(params), std::move(body));
+  return arena_.make<FunStmt>(name, std::move(params), std::move(body));
 }
 
 StmtPtr Parser::statement() {
-  if (match({TokenType::FOR})) {
+  if (match(TokenType::FOR)) {
     return forStatement();
   }
-  if (match({TokenType::IF}))
+  if (match(TokenType::IF))
     return ifStatement();
-  if (match({TokenType::PRINT}))
+  if (match(TokenType::PRINT))
     return printStatement();
-  if (match({TokenType::RETURN}))
+  if (match(TokenType::RETURN))
     return returnStatement();
-  if (match({TokenType::WHILE}))
+  if (match(TokenType::WHILE))
     return whileStatement();
-  if (match({TokenType::LEFT_BRACE}))
-    return std::make_unique<Block>(block());
+  if (match(TokenType::LEFT_BRACE))
+    return arena_.make<Block>(block());
 
   return expressionStatement();
 }
 
 StmtPtr Parser::returnStatement() {
-  Token keyword = previous();
+  const Token &keyword = previous();
   ExprPtr value = nullptr;
   if (!check(TokenType::SEMICOLON)) {
     value = expression();
   }
 
   consume(TokenType::SEMICOLON, "Expect ';' after return value.");
-  return std::make_unique<ReturnStmt>(keyword, std::move(value));
+  return arena_.make<ReturnStmt>(keyword, value);
 }
 
 StmtPtr Parser::ifStatement() {
@@ -330,20 +312,19 @@ StmtPtr Parser::ifStatement() {
   consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
   auto thenStmt = statement();
   StmtPtr elseStmt = nullptr;
-  if (match({TokenType::ELSE})) {
+  if (match(TokenType::ELSE)) {
     elseStmt = statement();
   }
 
-  return std::make_unique<IfStmt>(std::move(condition), std::move(thenStmt),
-                                  std::move(elseStmt));
+  return arena_.make<IfStmt>(condition, thenStmt, elseStmt);
 }
 
 StmtPtr Parser::forStatement() {
   consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'.");
   StmtPtr initializer = nullptr;
-  if (match({TokenType::SEMICOLON})) {
+  if (match(TokenType::SEMICOLON)) {
     // do nothing
-  } else if (match({TokenType::VAR})) {
+  } else if (match(TokenType::VAR)) {
     initializer = varStatement();
   } else {
     initializer = expressionStatement();
@@ -365,21 +346,21 @@ StmtPtr Parser::forStatement() {
 
   if (increment != nullptr) {
     std::vector<StmtPtr> stmts;
-    stmts.push_back(std::move(body));
-    stmts.push_back(std::make_unique<ExpressionStmt>(std::move(increment)));
-    body = std::make_unique<Block>(std::move(stmts));
+    stmts.push_back(body);
+    stmts.push_back(arena_.make<ExpressionStmt>(increment));
+    body = arena_.make<Block>(std::move(stmts));
   }
 
   if (condition == nullptr)
-    condition = std::make_unique<Literal>(true);
+    condition = arena_.make<Literal>(true);
 
-  body = std::make_unique<WhileStmt>(std::move(condition), std::move(body));
+  body = arena_.make<WhileStmt>(condition, body);
 
   if (initializer != nullptr) {
     std::vector<StmtPtr> stmts;
-    stmts.push_back(std::move(initializer));
-    stmts.push_back(std::move(body));
-    body = std::make_unique<Block>(std::move(stmts));
+    stmts.push_back(initializer);
+    stmts.push_back(body);
+    body = arena_.make<Block>(std::move(stmts));
   }
 
   return body;
@@ -391,13 +372,13 @@ StmtPtr Parser::whileStatement() {
   consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
   auto stmt = statement();
 
-  return std::make_unique<WhileStmt>(std::move(condition), std::move(stmt));
+  return arena_.make<WhileStmt>(condition, stmt);
 }
 
 StmtPtr Parser::printStatement() {
   ExprPtr value = expression();
   consume(TokenType::SEMICOLON, "Expect ';' after value.");
-  return std::make_unique<PrintStmt>(std::move(value));
+  return arena_.make<PrintStmt>(value);
 }
 
 std::vector<StmtPtr> Parser::block() {
@@ -413,17 +394,17 @@ std::vector<StmtPtr> Parser::block() {
 StmtPtr Parser::expressionStatement() {
   ExprPtr expr = expression();
   consume(TokenType::SEMICOLON, "Expect ';' after expression.");
-  return std::make_unique<ExpressionStmt>(std::move(expr));
+  return arena_.make<ExpressionStmt>(expr);
 }
 
 StmtPtr Parser::varStatement() {
-  Token name = consume(TokenType::IDENTIFIER, "Expect variable name.");
+  const Token &name = consume(TokenType::IDENTIFIER, "Expect variable name.");
   ExprPtr initializer = nullptr;
-  if (match({TokenType::EQUAL})) {
+  if (match(TokenType::EQUAL)) {
     initializer = expression();
   }
   consume(TokenType::SEMICOLON, "Expect ';' after expression.");
-  return std::make_unique<VarDecl>(name, std::move(initializer));
+  return arena_.make<VarDecl>(name, initializer);
 }
 
 std::vector<StmtPtr> Parser::parse() {
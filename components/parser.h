@@ -2,8 +2,12 @@
 
 #include "error.h"
 #include "expr.h"
+#include "program.h"
 #include "stmt.h"
 #include "token.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <vector>
 
@@ -26,6 +30,10 @@ primary        → NUMBER | STRING | "true" | "false" | "nil" | "this"
                | IDENTIFIER
                | "(" expression ")"
                | "super" "." IDENTIFIER ;
+
+Below assignment, the levels aren't separate functions: expressions are
+parsed by precedence climbing (Pratt parsing) driven by a table with a
+ParseRule per token type, built at compile time in parser.cpp.
 ***/
 /*** Statement
 program        → declaration* EOF ;
@@ -67,8 +75,10 @@ block          → "{" declaration* "}" ;
 ***/
 class Parser {
 public:
-  Parser(const std::vector<const Token> &tokens, ErrorReporter &errorReporter)
-      : tokens_(tokens), current_(0), errorReporter_(errorReporter) {}
+  Parser(const std::vector<Token> &tokens, AstArena &arena,
+         ErrorReporter &errorReporter)
+      : tokens_(tokens), arena_(arena), errorReporter_(errorReporter),
+        current_(0) {}
   // ExprPtr parse();
   std::vector<StmtPtr> parse();
 
@@ -86,22 +96,28 @@ private:
   StmtPtr classDeclaration();
   std::vector<StmtPtr> block();
   // ----------------------------------
-  bool match(const std::vector<TokenType> &&types);
+  bool match(TokenType type) {
+    if (check(type)) {
+      advance();
+      return true;
+    }
+    return false;
+  }
 
-  Token peek() { return tokens_[current_]; }
+  const Token &peek() const { return tokens_[current_]; }
 
-  Token previous() { return tokens_[current_ - 1]; }
+  const Token &previous() const { return tokens_[current_ - 1]; }
 
-  bool isAtEnd() { return peek().type == TokenType::EOF_; }
+  bool isAtEnd() const { return peek().type == TokenType::EOF_; }
 
-  Token advance() {
+  const Token &advance() {
     if (!isAtEnd()) {
       current_++;
     }
     return previous();
   }
 
-  bool check(TokenType type) {
+  bool check(TokenType type) const {
     if (isAtEnd()) {
       return false;
     }
@@ -109,23 +125,58 @@ private:
     return peek().type == type;
   }
 
+  // Binding power of an infix operator: an operand only extends to the
+  // operators that bind tighter than the one it follows.
+  enum class Precedence : uint8_t {
+    NONE,
+    ASSIGNMENT,
+    OR,
+    AND,
+    EQUALITY,
+    COMPARISON,
+    TERM,
+    FACTOR,
+    UNARY,
+    CALL,
+    PRIMARY
+  };
+  // Parse the rest of an expression whose first token was just consumed;
+  // an infix function also gets the expression to its left.
+  using PrefixFn = ExprPtr (Parser::*)();
+  using InfixFn = ExprPtr (Parser::*)(ExprPtr left);
+  struct ParseRule {
+    PrefixFn prefix = nullptr;
+    InfixFn infix = nullptr;
+    Precedence precedence = Precedence::NONE;
+  };
+  static constexpr size_t TOKEN_TYPES =
+      static_cast<size_t>(TokenType::EOF_) + 1;
+  static constexpr std::array<ParseRule, TOKEN_TYPES> buildRules();
+  static const ParseRule &rule(TokenType type);
+
   ExprPtr expression();
   ExprPtr assignment();
-  ExprPtr equality();
-  ExprPtr comparison();
-  ExprPtr term();
-  ExprPtr factor();
+  // An expression of operators binding at least as tight as `precedence`.
+  ExprPtr parsePrecedence(Precedence precedence);
+  // prefix rules
+  ExprPtr literal();
+  ExprPtr variable();
+  ExprPtr thisExpr();
+  ExprPtr superExpr();
+  ExprPtr grouping();
   ExprPtr unary();
-  ExprPtr primary();
-  ExprPtr orExpr();
-  ExprPtr andExpr();
-  ExprPtr call();
-  ExprPtr finishCall(ExprPtr expr);
-  Token consume(const TokenType type, const std::string &msg);
+  // infix rules
+  ExprPtr binary(ExprPtr left);
+  ExprPtr logical(ExprPtr left);
+  ExprPtr call(ExprPtr callee);
+  ExprPtr dot(ExprPtr object);
+  const Token &consume(const TokenType type, const std::string &msg);
   ParseError *error(const Token &token, const std::string &msg);
   void synchronize();
   // ----------------------------
-  const std::vector<const Token> &tokens_;
+  const std::vector<Token> &tokens_;
+  // every node is allocated here
+  AstArena &arena_;
   ErrorReporter &errorReporter_;
   int current_;
 };
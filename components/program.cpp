@@ -0,0 +1,24 @@
+#include "program.h"
+#include <algorithm>
+#include <cstdint>
+
+AstArena::~AstArena() {
+  for (auto it = destructors_.rbegin(); it != destructors_.rend(); ++it) {
+    it->destroy(it->node);
+  }
+}
+
+void *AstArena::allocate(size_t size, size_t align) {
+  auto addr = reinterpret_cast<uintptr_t>(next_);
+  auto aligned = (addr + align - 1) & ~(uintptr_t(align) - 1);
+  if (next_ == nullptr || aligned + size > reinterpret_cast<uintptr_t>(end_)) {
+    size_t chunkSize = std::max(CHUNK_SIZE, size + align);
+    chunks_.emplace_back(new std::byte[chunkSize]);
+    next_ = chunks_.back().get();
+    end_ = next_ + chunkSize;
+    addr = reinterpret_cast<uintptr_t>(next_);
+    aligned = (addr + align - 1) & ~(uintptr_t(align) - 1);
+  }
+  next_ = reinterpret_cast<std::byte *>(aligned + size);
+  return reinterpret_cast<void *>(aligned);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "stmt.h"
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Bump allocator for the AST nodes of one program.
+ *
+ * Nodes are laid out one after another in large chunks, in the order the
+ * parser creates them, instead of each being a separate heap allocation.
+ * They are destroyed together with the arena; node pointers are
+ * non-owning.
+ **/
+class AstArena {
+public:
+  AstArena() = default;
+  AstArena(const AstArena &) = delete;
+  AstArena &operator=(const AstArena &) = delete;
+  ~AstArena();
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    T *node = new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      destructors_.push_back(
+          {node, [](void *ptr) { static_cast<T *>(ptr)->~T(); }});
+    }
+    return node;
+  }
+
+private:
+  static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+  void *allocate(size_t size, size_t align);
+
+  struct Destructor {
+    void *node;
+    void (*destroy)(void *);
+  };
+
+  std::vector<std::unique_ptr<std::byte[]>> chunks_;
+  std::byte *next_ = nullptr;
+  std::byte *end_ = nullptr;
+  std::vector<Destructor> destructors_;
+};
+
+/**
+ * A parsed program: its source text, which the tokens' lexemes point
+ * into, and its AST. Functions and classes refer to the nodes they were
+ * declared by, so an engine that runs the AST needs the Program to stay
+ * alive as long as those may still be called.
+ **/
+struct Program {
+  explicit Program(std::string source) : source(std::move(source)) {}
+
+  const std::string source;
+  AstArena arena;
+  std::vector<StmtPtr> stmts;
+};
@@ -1,19 +1,27 @@
 #include "resolver.h"
-#include "interpreter.h"
+#include <algorithm>
 
-Resolver::Resolver(Interpreter &ip, ErrorReporter &errorReporter)
-    : ip_(ip), errorReporter_(errorReporter), scopes_(std::vector<SymbolMap>()),
+Resolver::Resolver(GlobalTable &globals, ErrorReporter &errorReporter)
+    : globals_(globals), errorReporter_(errorReporter),
+      scopes_(std::vector<Scope>()), functions_({FunctionFrame{0, 0, false, {}}}),
       currentFunction_(FunctionType::NONE), currentClass_(ClassType::NONE) {}
 
 StmtVisitorResT Resolver::visitBlock(const Block &block) {
+  if (!block.hasDeclarations) {
+    resolveStmts(block.stmts);
+    return StmtVisitorResT();
+  }
   beginScope();
-  resolve(block.stmts);
-  endScope();
+  resolveStmts(block.stmts);
+  block.needsEnvironment = endScope();
   return StmtVisitorResT();
 }
 
 StmtVisitorResT Resolver::visitVarDecl(const VarDecl &stmt) {
   declare(stmt.name);
+  if (!resolveBinding(stmt.binding, stmt.name.symbol())) {
+    defineGlobal(stmt.name.symbol());
+  }
   if (stmt.initializer != nullptr) {
     resolve(stmt.initializer);
   }
@@ -23,26 +31,39 @@ StmtVisitorResT Resolver::visitVarDecl(const VarDecl &stmt) {
 
 ExprVisitorResT Resolver::visitVariableExpr(const Variable &expr) {
   if (scopes_.size() > 0) {
-    const auto &top = scopes_.back();
-    if (top.find(expr.name.lexeme) != top.end() && !top.at(expr.name.lexeme)) {
+    const Scope &top = scopes_.back();
+    auto local = top.names.find(expr.name.symbol());
+    if (local != top.names.end() && !top.vars[local->second].defined) {
       errorReporter_.report(
-          expr.name.line, expr.name.lexeme,
+          expr.name.line, std::string(expr.name.lexeme),
           "Cannot read local variable in its own initializer.");
     }
   }
-  resolveLocal(expr, expr.name);
+  if (!resolveBinding(expr.binding, expr.name.symbol())) {
+    functions_.back().globals.push_back(expr.name.symbol());
+  }
   return ExprVisitorResT();
 }
 
 ExprVisitorResT Resolver::visitAssignmentExpr(const Assignment &expr) {
   resolve(expr.value);
-  resolveLocal(expr, expr.name);
+  if (!resolveBinding(expr.binding, expr.name.symbol())) {
+    defineGlobal(expr.name.symbol());
+    markImpure();
+  }
   return ExprVisitorResT();
 }
 
 StmtVisitorResT Resolver::visitFunStmt(const FunStmt &fun) {
   declare(fun.name);
   define(fun.name);
+  if (resolveBinding(fun.binding, fun.name.symbol())) {
+    // a new closure every time
+    markImpure();
+  } else {
+    defineGlobal(fun.name.symbol());
+    globalFunctions_[fun.name.symbol()] = &fun;
+  }
   resolveFun(fun, FunctionType::FUNCTION);
   return StmtVisitorResT();
 }
@@ -52,6 +73,10 @@ StmtVisitorResT Resolver::visitClassStmt(const ClassStmt &c) {
   currentClass_ = ClassType::CLASS;
   declare(c.name);
   define(c.name);
+  if (!resolveBinding(c.binding, c.name.symbol())) {
+    defineGlobal(c.name.symbol());
+  }
+  markImpure();
   if (c.super != nullptr && c.name.lexeme == c.super->name.lexeme) {
     errorReporter_.report(c.super->name.line,
                           " A class can't inherit from itself.");
@@ -61,18 +86,16 @@ StmtVisitorResT Resolver::visitClassStmt(const ClassStmt &c) {
     resolve(*c.super);
   }
   if (c.super != nullptr) {
+    // only ever referred to from methods, so always captured
     beginScope();
-    scopes_.back()["super"] = true;
+    declareLocal(intern("super"), true).captured = true;
   }
 
-  beginScope();
-  scopes_.back()["this"] = true;
   for (const auto &method : c.methods) {
     FunctionType decl = method->name.lexeme == "init" ? FunctionType::INIT
                                                       : FunctionType::METHOD;
     resolveFun(*method, decl);
   }
-  endScope();
   if (c.super != nullptr) {
     endScope();
   }
@@ -91,9 +114,11 @@ StmtVisitorResT Resolver::visitIfStmt(const IfStmt &stmt) {
   if (stmt.elseStmt != nullptr) {
     resolve(stmt.elseStmt);
   }
+  return StmtVisitorResT();
 }
 
 StmtVisitorResT Resolver::visitPrintStmt(const PrintStmt &stmt) {
+  markImpure();
   resolve(stmt.expr);
   return StmtVisitorResT();
 }
@@ -115,6 +140,9 @@ StmtVisitorResT Resolver::visitReturnStmt(const ReturnStmt &stmt) {
                             "Can't return a value from an initializer.");
     }
     resolve(stmt.value);
+    stmt.tailCall = (currentFunction_ == FunctionType::FUNCTION ||
+                     currentFunction_ == FunctionType::METHOD) &&
+                    dynamic_cast<const Call *>(stmt.value) != nullptr;
   }
   return StmtVisitorResT();
 }
@@ -132,6 +160,11 @@ ExprVisitorResT Resolver::visitLogicalExpr(const Logical &expr) {
 }
 
 ExprVisitorResT Resolver::visitCallExpr(const Call &expr) {
+  // only calls to global functions can be shown to be pure
+  auto callee = dynamic_cast<const Variable *>(expr.callee);
+  if (callee == nullptr || isLocal(callee->name.symbol())) {
+    markImpure();
+  }
   resolve(expr.callee);
   for (const auto &arg : expr.arguments) {
     resolve(arg);
@@ -145,39 +178,46 @@ ExprVisitorResT Resolver::visitGroupingExpr(const Grouping &expr) {
 }
 
 ExprVisitorResT Resolver::visitGetExpr(const Get &expr) {
+  // instances are mutable
+  markImpure();
   resolve(expr.object);
   return ExprVisitorResT();
 }
 
 ExprVisitorResT Resolver::visitSetExpr(const Set &expr) {
+  markImpure();
   resolve(expr.object);
   resolve(expr.value);
   return ExprVisitorResT();
 }
 
 ExprVisitorResT Resolver::visitThisExpr(const This &expr) {
+  markImpure();
   if (currentClass_ == ClassType::NONE) {
     errorReporter_.report(expr.keyword.line,
                           " Can't use 'this' outside of a class.");
     return ExprVisitorResT();
   }
-  resolveLocal(expr, expr.keyword);
+  resolveBinding(expr.binding, expr.keyword.symbol());
   return ExprVisitorResT();
 }
 
 ExprVisitorResT Resolver::visitSuperExpr(const Super &expr) {
+  markImpure();
   if (currentClass_ == ClassType::NONE) {
     errorReporter_.report(expr.keyword.line,
                           "Cannot use 'super' outside of a class.");
   } else if (currentClass_ != ClassType::SUBCLASS) {
     errorReporter_.report(expr.keyword.line,
                           "Cannot use 'super' in a class with no super class.");
+  } else {
+    resolveBinding(expr.thisBinding, intern("this"));
   }
-  resolveLocal(expr, expr.keyword);
+  resolveBinding(expr.binding, expr.keyword.symbol());
   return ExprVisitorResT();
 }
 
-ExprVisitorResT Resolver::visitLiteralExpr(const Literal &expr) {
+ExprVisitorResT Resolver::visitLiteralExpr(const Literal &) {
   return ExprVisitorResT();
 }
 
@@ -189,21 +229,112 @@ ExprVisitorResT Resolver::visitUnaryExpr(const Unary &expr) {
 void Resolver::resolveFun(const FunStmt &fun, FunctionType type) {
   FunctionType enclosingFunction = currentFunction_;
   currentFunction_ = type;
+  functions_.push_back(FunctionFrame{0, 0, false, {}});
   beginScope();
+  if (type == FunctionType::METHOD || type == FunctionType::INIT) {
+    declareLocal(intern("this"), true);
+  }
   for (const auto &param : fun.params) {
     declare(param);
     define(param);
   }
-  resolve(fun.body);
-  endScope();
+  resolveStmts(fun.body);
+  // "this" and the parameters come first, so their slots are their indices
+  const std::vector<LocalVar> &vars = scopes_.back().vars;
+  size_t paramCount = fun.params.size() + (type == FunctionType::METHOD ||
+                                           type == FunctionType::INIT);
+  for (size_t i = 0; i < std::min(paramCount, vars.size()); i++) {
+    if (vars[i].captured) {
+      fun.capturedParams.push_back(vars[i].slot);
+    }
+  }
+  fun.needsEnvironment = endScope();
+  fun.frameSize = functions_.back().frameSize;
+  if (type == FunctionType::FUNCTION && !functions_.back().impure) {
+    candidates_.push_back(
+        PureCandidate{&fun, std::move(functions_.back().globals)});
+  }
+  functions_.pop_back();
   currentFunction_ = enclosingFunction;
 }
 
-void Resolver::beginScope() { scopes_.push_back(SymbolMap()); }
+void Resolver::beginScope() {
+  int parent = scopes_.empty() ? -1 : scopes_.back().id;
+  int id = scopeInfos_.size();
+  scopeInfos_.push_back(ScopeInfo{parent, false});
+  scopes_.push_back(
+      Scope{SymbolMap<int>(), std::vector<LocalVar>(), id,
+            static_cast<int>(functions_.size() - 1)});
+}
+
+bool Resolver::endScope() {
+  Scope &scope = scopes_.back();
+  ScopeInfo &info = scopeInfos_[scope.id];
+  for (const LocalVar &var : scope.vars) {
+    info.hasEnvironment = info.hasEnvironment || var.captured;
+  }
+
+  int envSlot = 0;
+  for (const LocalVar &var : scope.vars) {
+    if (!var.captured) {
+      for (const VarUse &use : var.uses) {
+        use.binding->type = BindingType::LOCAL;
+        use.binding->loc = Location{0, var.slot};
+      }
+      continue;
+    }
+    for (const VarUse &use : var.uses) {
+      // every scope in between has ended, so hasEnvironment is final
+      int depth = 0;
+      for (int id = use.scope; id != scope.id; id = scopeInfos_[id].parent) {
+        depth += scopeInfos_[id].hasEnvironment;
+      }
+      use.binding->type = BindingType::CAPTURED;
+      use.binding->loc = Location{depth, envSlot};
+    }
+    envSlot++;
+  }
 
-void Resolver::endScope() { scopes_.pop_back(); }
+  // the scope's stack slots are free for its siblings
+  functions_.back().nextSlot -= scope.vars.size();
+  scopes_.pop_back();
+  return info.hasEnvironment;
+}
 
 void Resolver::resolve(const std::vector<StmtPtr> &stmts) {
+  resolveStmts(stmts);
+  markPureFunctions();
+}
+
+void Resolver::markPureFunctions() {
+  for (const PureCandidate &candidate : candidates_) {
+    candidate.fun->pure = true;
+  }
+  // Start from all candidates and drop the ones that refer to a global
+  // other than a pure function declared once (and never assigned) in this
+  // program, until nothing changes; recursive functions stay pure.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const PureCandidate &candidate : candidates_) {
+      if (!candidate.fun->pure) {
+        continue;
+      }
+      for (const LoxString *name : candidate.globals) {
+        auto fun = globalFunctions_.find(name);
+        if (fun == globalFunctions_.end() || globalDefinitions_[name] != 1 ||
+            !fun->second->pure) {
+          candidate.fun->pure = false;
+          changed = true;
+          break;
+        }
+      }
+    }
+  }
+  candidates_.clear();
+}
+
+void Resolver::resolveStmts(const std::vector<StmtPtr> &stmts) {
   for (const auto &stmt : stmts) {
     resolve(stmt);
   }
@@ -215,28 +346,60 @@ void Resolver::resolve(const Stmt &stmt) { stmt.accept(*this); }
 void Resolver::resolve(const ExprPtr &expr) { expr->accept(*this); }
 void Resolver::resolve(const Expr &expr) { expr.accept(*this); }
 
-void Resolver::resolveLocal(const Expr &expr, const Token &name) {
+bool Resolver::resolveBinding(Binding &binding, const LoxString *name) {
   for (int i = scopes_.size() - 1; i >= 0; i--) {
-    if (scopes_[i].find(name.lexeme) != scopes_[i].end()) {
-      ip_.resolve(expr, scopes_.size() - 1 - i);
-      return;
+    Scope &scope = scopes_[i];
+    auto local = scope.names.find(name);
+    if (local != scope.names.end()) {
+      LocalVar &var = scope.vars[local->second];
+      if (scope.function != static_cast<int>(functions_.size() - 1)) {
+        var.captured = true;
+        // its value can differ between calls
+        markImpure();
+      }
+      var.uses.push_back(VarUse{&binding, scopes_.back().id});
+      return true;
     }
   }
+  binding.type = BindingType::GLOBAL;
+  binding.loc = Location{0, globals_.slotFor(name)};
+  return false;
+}
+
+bool Resolver::isLocal(const LoxString *name) const {
+  for (const Scope &scope : scopes_) {
+    if (scope.names.find(name) != scope.names.end()) {
+      return true;
+    }
+  }
+  return false;
 }
 
 void Resolver::declare(const Token &name) {
   if (scopes_.size() > 0) {
-    auto &top = scopes_.back();
-    if (top.find(name.lexeme) != top.end()) {
-      errorReporter_.report(name.line, name.lexeme,
+    const auto &names = scopes_.back().names;
+    if (names.find(name.symbol()) != names.end()) {
+      errorReporter_.report(name.line, std::string(name.lexeme),
                             "Already a variable with this name in this scope.");
+      return;
     }
-    top[name.lexeme] = false;
+    declareLocal(name.symbol(), false);
   }
 }
 
 void Resolver::define(const Token &name) {
   if (scopes_.size() > 0) {
-    scopes_.back()[name.lexeme] = true;
+    Scope &scope = scopes_.back();
+    scope.vars[scope.names.at(name.symbol())].defined = true;
   }
 }
+
+LocalVar &Resolver::declareLocal(const LoxString *name, bool defined) {
+  Scope &scope = scopes_.back();
+  FunctionFrame &function = functions_.back();
+  int slot = function.nextSlot++;
+  function.frameSize = std::max(function.frameSize, function.nextSlot);
+  scope.names[name] = scope.vars.size();
+  scope.vars.push_back(LocalVar{defined, false, slot, {}});
+  return scope.vars.back();
+}
@@ -2,22 +2,57 @@
 
 #include "error.h"
 #include "expr.h"
+#include "globals.h"
+#include "loxstring.h"
 #include "stmt.h"
 #include <unordered_map>
 #include <vector>
 
-// Value meaning:
-// false: variable declared but not defined (i.e. initializer not ran)
-// true: variable defined
-using SymbolMap = std::unordered_map<std::string, bool>;
+// A reference to a local, patched once its scope ends and the Resolver
+// knows whether the variable is captured. `scope` is the innermost scope
+// at the point of use.
+struct VarUse {
+  Binding *binding;
+  int scope;
+};
+
+// defined:
+//   false: variable declared but not defined (i.e. initializer not ran)
+//   true: variable defined
+// captured: an inner function refers to the variable, so it lives in its
+//   scope's Environment instead of the stack frame
+// slot: index of the variable in its function's stack frame
+struct LocalVar {
+  bool defined;
+  bool captured;
+  int slot;
+  std::vector<VarUse> uses;
+};
+
+struct Scope {
+  // index into vars
+  SymbolMap<int> names;
+  // in declaration order, which is also the order of the captured ones
+  // in the scope's Environment
+  std::vector<LocalVar> vars;
+  int id;
+  // index of the function (in Resolver::functions_) the scope belongs to
+  int function;
+};
+
+// Scopes outlive their place on the scope stack: a captured variable's
+// depth counts the scopes with an Environment between the use and the
+// declaration, which is only known once they have all ended.
+struct ScopeInfo {
+  int parent;
+  bool hasEnvironment;
+};
 
-enum class FunctionType { NONE, FUNCTION, METHOD, INIT };
 enum class ClassType { NONE, CLASS, SUBCLASS };
 
-class Interpreter;
 class Resolver : public ExprVisitor, public StmtVisitor {
 public:
-  explicit Resolver(Interpreter &ip, ErrorReporter &errorReporter);
+  Resolver(GlobalTable &globals, ErrorReporter &errorReporter);
   ExprVisitorResT visitBinaryExpr(const Binary &expr) override;
   ExprVisitorResT visitGroupingExpr(const Grouping &expr) override;
   ExprVisitorResT visitLiteralExpr(const Literal &expr) override;
@@ -39,23 +74,58 @@ public:
   StmtVisitorResT visitFunStmt(const FunStmt &stmt) override;
   StmtVisitorResT visitReturnStmt(const ReturnStmt &stmt) override;
   StmtVisitorResT visitClassStmt(const ClassStmt &stmt) override;
+  // Resolves a whole program, then marks its pure functions.
   void resolve(const std::vector<StmtPtr> &stmts);
+  // stack slots top-level code needs for the locals of its blocks
+  int scriptFrameSize() const { return functions_.front().frameSize; }
 
 private:
+  // impure: the function does something a memoized call would skip or
+  //   repeat wrongly (see markPureFunctions)
+  // globals: the global names it refers to, pure only if they are
+  struct FunctionFrame {
+    int nextSlot;
+    int frameSize;
+    bool impure;
+    std::vector<const LoxString *> globals;
+  };
+
+  struct PureCandidate {
+    const FunStmt *fun;
+    std::vector<const LoxString *> globals;
+  };
+
+  void resolveStmts(const std::vector<StmtPtr> &stmts);
   void resolve(const StmtPtr &stmt);
   void resolve(const Stmt &stmt);
   void resolve(const Expr &expr);
   void resolve(const ExprPtr &expr);
-  void resolveLocal(const Expr &expr, const Token &name);
+  // Returns false if `name` is a global.
+  bool resolveBinding(Binding &binding, const LoxString *name);
+  bool isLocal(const LoxString *name) const;
+  void markImpure() { functions_.back().impure = true; }
+  void defineGlobal(const LoxString *name) { globalDefinitions_[name]++; }
+  void markPureFunctions();
   void resolveFun(const FunStmt &fun, FunctionType type);
   void beginScope();
-  void endScope();
+  // Returns whether the scope needs an Environment at runtime.
+  bool endScope();
   void declare(const Token &name);
   void define(const Token &name);
+  LocalVar &declareLocal(const LoxString *name, bool defined);
 
-  Interpreter &ip_;
+  GlobalTable &globals_;
   ErrorReporter &errorReporter_;
-  std::vector<SymbolMap> scopes_;
+  std::vector<Scope> scopes_;
+  std::vector<ScopeInfo> scopeInfos_;
+  // the script, then the functions being resolved, innermost last
+  std::vector<FunctionFrame> functions_;
   FunctionType currentFunction_;
   ClassType currentClass_;
+  // functions with no impure statement or expression of their own
+  std::vector<PureCandidate> candidates_;
+  // how often each global is declared or assigned, and the function
+  // declarations among those
+  SymbolMap<int> globalDefinitions_;
+  SymbolMap<const FunStmt *> globalFunctions_;
 };
@@ -1,6 +1,14 @@
 #include "scanner.h"
-#include <iostream>
-#include <unordered_map>
+#include "loxstring.h"
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace {
 bool isDigit(char c) { return c >= '0' && c <= '9'; }
@@ -10,23 +18,222 @@ bool isAlpha(char c) {
 }
 
 bool isAlphaNumeric(char c) { return isAlpha(c) || isDigit(c); }
+
+bool isWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/**
+ * Long runs of whitespace, identifier characters and digits, and the
+ * insides of strings, are scanned 16 bytes at a time where SSE2 is
+ * available (always, on x86-64): a comparison per character class gives
+ * a bit mask per chunk, and the first clear bit ends the run.
+ *
+ * Most runs are a few bytes long (a single space, a short name), and for
+ * those the scalar loop is faster, so chunks are only used once a run is
+ * longer than SHORT_RUN. The tail of the source, and targets without
+ * SSE2, use the scalar loop throughout.
+ **/
+#if defined(__SSE2__)
+const ptrdiff_t CHUNK = 16;
+const ptrdiff_t SHORT_RUN = 8;
+
+__m128i load(const char *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+unsigned bits(__m128i matches) { return _mm_movemask_epi8(matches); }
+
+unsigned equal(__m128i chunk, char c) {
+  return bits(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(c)));
+}
+
+// Bytes >= 0x80 compare as negative, so they are never in range.
+__m128i inRange(__m128i chunk, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(lo - 1)),
+                       _mm_cmplt_epi8(chunk, _mm_set1_epi8(hi + 1)));
+}
+
+// Newlines among the bits of `newlines`; there are rarely more than one
+// or two, and POPCNT isn't part of baseline x86-64.
+int countLines(unsigned newlines) {
+  int count = 0;
+  for (; newlines != 0; newlines &= newlines - 1) {
+    count++;
+  }
+  return count;
+}
+#endif
+
+struct Digits {
+  static bool contains(char c) { return isDigit(c); }
+#if defined(__SSE2__)
+  static unsigned contains(__m128i chunk) {
+    return bits(inRange(chunk, '0', '9'));
+  }
+#endif
+};
+
+struct AlphaNumerics {
+  static bool contains(char c) { return isAlphaNumeric(c); }
+#if defined(__SSE2__)
+  static unsigned contains(__m128i chunk) {
+    // setting 0x20 folds upper case letters onto lower case ones and maps
+    // no other character into a-z
+    __m128i folded = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+    return bits(inRange(folded, 'a', 'z')) | Digits::contains(chunk) |
+           equal(chunk, '_');
+  }
+#endif
+};
+
+// First character at or after p that isn't in Class, or end.
+template <typename Class> const char *skipRun(const char *p, const char *end) {
+#if defined(__SSE2__)
+  const char *shortEnd = end - p > SHORT_RUN ? p + SHORT_RUN : end;
+  while (p < shortEnd && Class::contains(*p)) {
+    p++;
+  }
+  if (p < shortEnd || p == end) {
+    return p;
+  }
+  for (; end - p >= CHUNK; p += CHUNK) {
+    unsigned outside = ~Class::contains(load(p)) & 0xFFFF;
+    if (outside != 0) {
+      return p + std::countr_zero(outside);
+    }
+  }
+#endif
+  while (p < end && Class::contains(*p)) {
+    p++;
+  }
+  return p;
+}
+
+// Skips whitespace, adding the newlines passed to `line`.
+const char *skipWhitespace(const char *p, const char *end, int &line) {
+#if defined(__SSE2__)
+  const char *shortEnd = end - p > SHORT_RUN ? p + SHORT_RUN : end;
+  for (; p < shortEnd && isWhitespace(*p); p++) {
+    line += *p == '\n';
+  }
+  if (p < shortEnd || p == end) {
+    return p;
+  }
+  for (; end - p >= CHUNK; p += CHUNK) {
+    __m128i chunk = load(p);
+    unsigned newlines = equal(chunk, '\n');
+    unsigned outside = ~(newlines | equal(chunk, ' ') | equal(chunk, '\t') |
+                         equal(chunk, '\r')) &
+                       0xFFFF;
+    if (outside != 0) {
+      line += countLines(newlines & ((1u << std::countr_zero(outside)) - 1));
+      return p + std::countr_zero(outside);
+    }
+    line += countLines(newlines);
+  }
+#endif
+  for (; p < end && isWhitespace(*p); p++) {
+    line += *p == '\n';
+  }
+  return p;
+}
+
+// The next `quote`, or end, adding the newlines passed to `line`.
+const char *findQuote(const char *p, const char *end, char quote, int &line) {
+#if defined(__SSE2__)
+  for (; end - p >= CHUNK; p += CHUNK) {
+    __m128i chunk = load(p);
+    unsigned newlines = equal(chunk, '\n');
+    unsigned quotes = equal(chunk, quote);
+    if (quotes != 0) {
+      line += countLines(newlines & ((1u << std::countr_zero(quotes)) - 1));
+      return p + std::countr_zero(quotes);
+    }
+    line += countLines(newlines);
+  }
+#endif
+  for (; p < end && *p != quote; p++) {
+    line += *p == '\n';
+  }
+  return p;
+}
+
+/**
+ * Keywords are found with a perfect hash built at compile time: the
+ * first and last letter and the length tell all sixteen apart. A
+ * collision in buildKeywordTable() throws, which fails the build, so a
+ * new keyword can't silently break lookups.
+ **/
+struct Keyword {
+  std::string_view name;
+  TokenType type = TokenType::IDENTIFIER;
+};
+
+constexpr Keyword KEYWORDS[] = {
+    {"and", TokenType::AND},       {"class", TokenType::CLASS},
+    {"else", TokenType::ELSE},     {"false", TokenType::FALSE},
+    {"for", TokenType::FOR},       {"if", TokenType::IF},
+    {"fun", TokenType::FUN},       {"nil", TokenType::NIL},
+    {"or", TokenType::OR},         {"print", TokenType::PRINT},
+    {"return", TokenType::RETURN}, {"super", TokenType::SUPER},
+    {"this", TokenType::THIS},     {"true", TokenType::TRUE},
+    {"var", TokenType::VAR},       {"while", TokenType::WHILE},
+};
+
+const size_t KEYWORD_TABLE_SIZE = 32;
+
+// `word` is never empty.
+constexpr size_t keywordHash(std::string_view word) {
+  return (static_cast<unsigned char>(word.front()) +
+          static_cast<unsigned char>(word.back()) * 5 + word.size()) &
+         (KEYWORD_TABLE_SIZE - 1);
+}
+
+constexpr std::array<Keyword, KEYWORD_TABLE_SIZE> buildKeywordTable() {
+  std::array<Keyword, KEYWORD_TABLE_SIZE> table{};
+  for (const Keyword &keyword : KEYWORDS) {
+    Keyword &slot = table[keywordHash(keyword.name)];
+    if (!slot.name.empty()) {
+      throw "keyword hash collision";
+    }
+    slot = keyword;
+  }
+  return table;
+}
+
+constexpr std::array<Keyword, KEYWORD_TABLE_SIZE> KEYWORD_TABLE =
+    buildKeywordTable();
+
+TokenType keywordType(std::string_view word) {
+  const Keyword &keyword = KEYWORD_TABLE[keywordHash(word)];
+  return keyword.name == word ? keyword.type : TokenType::IDENTIFIER;
+}
 } // namespace
 
-const std::vector<const Token> &Scanner::scanTokens() {
-  while (!isAtEnd()) {
+const std::vector<Token> &Scanner::scanTokens() {
+  // A token per eight bytes covers commented code; denser code grows the
+  // vector once or twice rather than every script reserving for the
+  // densest case.
+  tokens_.reserve(source_.length() / 8 + 1);
+  while (true) {
+    skipWhitespace();
+    if (isAtEnd()) {
+      break;
+    }
     // we're at the beginning of the next lexme
     start_ = current_;
     scanToken();
   }
 
-  tokens_.emplace_back(TokenType::EOF_, "", std::make_any<int>(0), line_);
+  tokens_.push_back(Token{"", Value(), line_, TokenType::EOF_});
 
   return tokens_;
 }
 
-void Scanner::addToken(TokenType type, const std::any &literal) {
-  std::string text = source_.substr(start_, current_ - start_);
-  tokens_.emplace_back(type, text, literal, line_);
+void Scanner::addToken(TokenType type, const Value &literal) {
+  tokens_.push_back(Token{source_.substr(start_, current_ - start_), literal,
+                          line_, type});
 }
 
 bool Scanner::match(char expected) {
@@ -51,6 +258,10 @@ char Scanner::peekNext() {
   return source_[current_ + 1];
 }
 
+void Scanner::skipWhitespace() {
+  current_ = ::skipWhitespace(at(current_), end(), line_) - begin();
+}
+
 void Scanner::scanToken() {
   char c = advance();
   switch (c) {
@@ -98,19 +309,14 @@ void Scanner::scanToken() {
     break;
   case '/':
     if (match('/')) {
-      while (peek() != '\n' && !isAtEnd())
-        advance();
+      // up to the newline, which the next skipWhitespace() counts
+      auto newline = static_cast<const char *>(
+          std::memchr(at(current_), '\n', end() - at(current_)));
+      current_ = newline != nullptr ? newline - begin() : source_.length();
     } else {
       addToken(TokenType::SLASH);
     }
     break;
-  case ' ':
-  case '\t':
-  case '\r':
-    break;
-  case '\n':
-    line_++;
-    break;
   case '"':
     string();
     break;
@@ -127,11 +333,7 @@ void Scanner::scanToken() {
 }
 
 void Scanner::string() {
-  while (peek() != '"' && !isAtEnd()) {
-    if (peek() == '\n')
-      line_++;
-    advance();
-  }
+  current_ = findQuote(at(current_), end(), '"', line_) - begin();
 
   if (isAtEnd()) {
     errorReporter_.report(line_, "", "Unterminated string.");
@@ -142,52 +344,42 @@ void Scanner::string() {
   advance();
 
   // Trim the surrounding quotes.
-  std::string value = source_.substr(start_ + 1, current_ - start_ - 2);
-  addToken(TokenType::STRING, value);
+  std::string_view value = source_.substr(start_ + 1, current_ - start_ - 2);
+  addToken(TokenType::STRING, intern(value));
 }
 
 void Scanner::number() {
-  while (isDigit(peek()))
-    advance();
+  current_ = skipRun<Digits>(at(current_), end()) - begin();
 
   // Look for a fractional part.
   if (peek() == '.' && isDigit(peekNext())) {
     // Consume the "."
     advance();
 
-    while (isDigit(peek()))
-      advance();
+    current_ = skipRun<Digits>(at(current_), end()) - begin();
   }
 
-  std::string numStr = source_.substr(start_, current_ - start_);
+  // parses in place; the lexeme is all digits, so only the range can fail
   double res = 0;
-  try {
-    res = stod(numStr);
-  } catch (std::invalid_argument const &ex) {
-    std::cout << "numStr [" << numStr << "] cannot be converted to double"
-              << std::endl;
-    std::cout << ex.what() << std::endl;
+  auto result = std::from_chars(source_.data() + start_,
+                                source_.data() + current_, res);
+  if (result.ec != std::errc()) {
+    std::string lexeme(source_.substr(start_, current_ - start_));
+    errorReporter_.report(line_, lexeme, "Number literal out of range.");
   }
 
   addToken(TokenType::NUMBER, res);
 }
 
 void Scanner::identifier() {
-  while (isAlphaNumeric(peek()))
-    advance();
-  static const std::unordered_map<std::string, TokenType> keywords{
-      {"and", TokenType::AND},       {"class", TokenType::CLASS},
-      {"else", TokenType::ELSE},     {"false", TokenType::FALSE},
-      {"for", TokenType::FOR},       {"if", TokenType::IF},
-      {"fun", TokenType::FUN},       {"nil", TokenType::NIL},
-      {"or", TokenType::OR},         {"print", TokenType::PRINT},
-      {"return", TokenType::RETURN}, {"super", TokenType::SUPER},
-      {"this", TokenType::THIS},     {"true", TokenType::TRUE},
-      {"var", TokenType::VAR},       {"while", TokenType::WHILE},
-  };
-
-  std::string value = source_.substr(start_, current_ - start_);
-  auto type = keywords.find(value) != keywords.end() ? keywords.at(value)
-                                                     : TokenType::IDENTIFIER;
+  current_ = skipRun<AlphaNumerics>(at(current_), end()) - begin();
+
+  std::string_view value = source_.substr(start_, current_ - start_);
+  TokenType type = keywordType(value);
+  if (type == TokenType::IDENTIFIER || type == TokenType::THIS ||
+      type == TokenType::SUPER) {
+    addToken(type, intern(value));
+    return;
+  }
   addToken(type);
 }
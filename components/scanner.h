@@ -2,26 +2,32 @@
 
 #include "error.h"
 #include "token.h"
-#include <any>
+#include <cstddef>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Scanner {
 public:
-  Scanner(const std::string &source, const ErrorReporter &errorReporter)
+  // `source` must outlive the tokens, whose lexemes point into it
+  Scanner(std::string_view source, const ErrorReporter &errorReporter)
       : source_(source), errorReporter_(errorReporter), tokens_({}), start_(0),
         current_(0), line_(1) {}
-  const std::vector<const Token> &scanTokens();
+  const std::vector<Token> &scanTokens();
 
 private:
   bool isAtEnd() { return current_ >= source_.length(); }
   char advance() { return source_[current_++]; }
+  const char *begin() const { return source_.data(); }
+  const char *end() const { return source_.data() + source_.length(); }
+  const char *at(size_t offset) const { return source_.data() + offset; }
+  // Skips whitespace, counting lines, before a token.
+  void skipWhitespace();
   void addToken(TokenType type) {
-    static std::any EMPTY_ANY;
-    addToken(type, EMPTY_ANY);
+    addToken(type, Value());
   }
 
-  void addToken(TokenType type, const std::any &literal);
+  void addToken(TokenType type, const Value &literal);
   void scanToken();
   bool match(char expected);
   char peek();
@@ -30,8 +36,9 @@ private:
   void number();
   void identifier();
 
-  const std::string source_;
+  const std::string_view source_;
   const ErrorReporter &errorReporter_;
-  std::vector<const Token> tokens_;
-  int start_, current_, line_;
+  std::vector<Token> tokens_;
+  size_t start_, current_;
+  int line_;
 };
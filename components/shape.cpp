@@ -0,0 +1,52 @@
+#include "shape.h"
+#include "gc.h"
+#include <algorithm>
+
+Shape::Shape(Shape *parent, const LoxString *name)
+    : id_(nextId()), root_(parent->root_), owner_(parent->owner_),
+      expectedFields_(0),
+      names_(parent->names_) {
+  names_.push_back(name);
+  if (names_.size() > MAX_LINEAR_FIELDS) {
+    index_ = std::make_unique<SymbolMap<int>>();
+    for (size_t i = 0; i < names_.size(); i++) {
+      (*index_)[names_[i]] = i;
+    }
+  }
+  root_->expectedFields_ = std::max(root_->expectedFields_, fieldCount());
+}
+
+int Shape::lookup(const LoxString *name) const {
+  if (index_ != nullptr) {
+    auto it = index_->find(name);
+    return it == index_->end() ? -1 : it->second;
+  }
+  for (size_t i = 0; i < names_.size(); i++) {
+    if (names_[i] == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+Shape *Shape::transition(const LoxString *name) {
+  auto &next = transitions_[name];
+  if (next == nullptr) {
+    next.reset(new Shape(this, name));
+    gc().charge(owner_, next->bytes());
+  }
+  return next.get();
+}
+
+size_t Shape::bytes() const {
+  // a hash table entry is counted as its node: the pair and a link
+  size_t transition =
+      sizeof(decltype(transitions_)::value_type) + sizeof(void *);
+  size_t bytes = sizeof(Shape) + transition +
+                 names_.capacity() * sizeof(const LoxString *);
+  if (index_ != nullptr) {
+    bytes += index_->size() *
+             (sizeof(SymbolMap<int>::value_type) + sizeof(void *));
+  }
+  return bytes;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "loxstring.h"
+#include "object.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Hidden class describing the field layout of LoxInstances.
+ *
+ * Every class has a root (empty) shape. Adding a field to an instance
+ * moves it along a transition to the shape that has that one extra field,
+ * so instances that get the same fields in the same order (e.g. built by
+ * the same initializer) share one shape, and each of them only stores its
+ * field values in a vector indexed by the shape's slots.
+ *
+ * The tree lives as long as the class owning it, so the memory shapes
+ * take is charged to the class.
+ **/
+class Shape {
+public:
+  explicit Shape(const Object *owner)
+      : id_(nextId()), root_(this), owner_(owner), expectedFields_(0) {}
+  Shape(const Shape &) = delete;
+  Shape &operator=(const Shape &) = delete;
+
+  // slot of the field `name`, or -1 if this shape doesn't have it
+  int lookup(const LoxString *name) const;
+  // shape with the field `name` appended; created on first use
+  Shape *transition(const LoxString *name);
+  int fieldCount() const { return names_.size(); }
+  // most fields any instance starting at this shape's root has grown to,
+  // so new instances can size their field storage up front
+  int expectedFields() const { return root_->expectedFields_; }
+  // Unique for the whole run, unlike the address: a collected class frees
+  // its shapes, and a later shape may be allocated at the same address.
+  uint64_t id() const { return id_; }
+
+private:
+  // shapes with many fields index them instead of scanning names_
+  static const int MAX_LINEAR_FIELDS = 8;
+
+  Shape(Shape *parent, const LoxString *name);
+  // bytes taken by this shape and its entry in the parent's transitions
+  size_t bytes() const;
+  static uint64_t nextId() {
+    static uint64_t lastId = 0;
+    return ++lastId;
+  }
+
+  const uint64_t id_;
+  Shape *root_;
+  // the root's class
+  const Object *owner_;
+  int expectedFields_;
+  // field names are interned, so they compare by pointer
+  std::vector<const LoxString *> names_;
+  std::unique_ptr<SymbolMap<int>> index_;
+  SymbolMap<std::unique_ptr<Shape>> transitions_;
+};
+
+class LoxFunction;
+
+/**
+ * Inline cache of one property access site (a Get or Set node, or a VM
+ * property instruction), keyed by the receiver's shape id. Every class
+ * has its own shape tree, so a shape also determines the class, and a hit
+ * resolves the field slot, the method to bind, or the transition to take
+ * when adding the field.
+ *
+ * The cache doesn't keep the class alive: an entry can only hit for an
+ * instance with that shape, whose class (owning the shapes and methods
+ * the entry points to) is then still reachable.
+ *
+ * The cache is polymorphic up to MAX_ENTRIES shapes; sites that see more
+ * are megamorphic and take the slow path for the shapes that didn't fit.
+ **/
+class PropertyCache {
+public:
+  struct Entry {
+    uint64_t shapeId;
+    // field slot, or -1 for a method. VM sites cache -1 for any name that
+    // isn't a field and look methods up in the class.
+    int slot;
+    LoxFunction *method;
+    // Set only: shape after adding the field, nullptr if it already exists
+    Shape *next;
+  };
+
+  const Entry *find(const Shape *shape) const {
+    for (int i = 0; i < size_; i++) {
+      if (entries_[i].shapeId == shape->id()) {
+        return &entries_[i];
+      }
+    }
+    return nullptr;
+  }
+  void add(Entry entry) {
+    if (size_ < MAX_ENTRIES) {
+      entries_[size_++] = entry;
+    }
+  }
+
+private:
+  static const int MAX_ENTRIES = 4;
+
+  Entry entries_[MAX_ENTRIES];
+  int size_ = 0;
+};
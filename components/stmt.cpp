@@ -35,3 +35,19 @@ StmtVisitorResT ReturnStmt::accept(StmtVisitor &visitor) const {
 StmtVisitorResT ClassStmt::accept(StmtVisitor &visitor) const {
   return visitor.visitClassStmt(*this);
 }
+
+namespace {
+bool declaresNames(const std::vector<StmtPtr> &stmts) {
+  for (const auto &stmt : stmts) {
+    if (dynamic_cast<const VarDecl *>(stmt) != nullptr ||
+        dynamic_cast<const FunStmt *>(stmt) != nullptr ||
+        dynamic_cast<const ClassStmt *>(stmt) != nullptr) {
+      return true;
+    }
+  }
+  return false;
+}
+} // namespace
+
+Block::Block(std::vector<StmtPtr> stmts)
+    : stmts(std::move(stmts)), hasDeclarations(declaresNames(this->stmts)) {}
@@ -2,10 +2,13 @@
 
 #include "expr.h"
 #include "token.h"
-#include <memory>
 #include <vector>
 
-using StmtVisitorResT = void;
+// How a statement finished. RETURN unwinds the enclosing blocks and loops
+// up to the function call, which picks up the value the interpreter kept.
+enum class Completion { NORMAL, RETURN };
+
+using StmtVisitorResT = Completion;
 
 class StmtVisitor;
 
@@ -15,55 +18,61 @@ public:
   virtual ~Stmt() = default;
 };
 
-using StmtPtr = std::unique_ptr<Stmt>;
+// Nodes are owned by the AstArena of their Program (see program.h).
+using StmtPtr = const Stmt *;
 
 class ExpressionStmt : public Stmt {
 public:
-  ExpressionStmt(ExprPtr expr) : expr(std::move(expr)) {}
+  ExpressionStmt(ExprPtr expr) : expr(expr) {}
   StmtVisitorResT accept(StmtVisitor &visitor) const override;
 
   const ExprPtr expr;
 };
 
-using ExpressionStmtPtr = std::unique_ptr<ExpressionStmt>;
+using ExpressionStmtPtr = const ExpressionStmt *;
 
 class PrintStmt : public Stmt {
 public:
-  PrintStmt(ExprPtr expr) : expr(std::move(expr)) {}
+  PrintStmt(ExprPtr expr) : expr(expr) {}
   StmtVisitorResT accept(StmtVisitor &visitor) const override;
 
   const ExprPtr expr;
 };
 
-using PrintStmtPtr = std::unique_ptr<PrintStmt>;
+using PrintStmtPtr = const PrintStmt *;
 
 class VarDecl : public Stmt {
 public:
-  VarDecl(const Token &name, ExprPtr expr)
-      : name(name), initializer(std::move(expr)) {}
+  VarDecl(const Token &name, ExprPtr expr) : name(name), initializer(expr) {}
   StmtVisitorResT accept(StmtVisitor &visitor) const override;
 
   const Token name;
   const ExprPtr initializer;
+  mutable Binding binding;
 };
 
-using VarDeclPtr = std::unique_ptr<VarDecl>;
+using VarDeclPtr = const VarDecl *;
 
 class Block : public Stmt {
 public:
-  Block(std::vector<StmtPtr> stmts) : stmts(std::move(stmts)) {}
+  Block(std::vector<StmtPtr> stmts);
   StmtVisitorResT accept(StmtVisitor &visitor) const override;
 
   const std::vector<StmtPtr> stmts;
+  // Only blocks that declare a variable, function or class get a scope
+  // of their own.
+  const bool hasDeclarations;
+  // Set by the Resolver when a closure captures one of the block's
+  // variables; only then does the block get an Environment at runtime.
+  mutable bool needsEnvironment = false;
 };
 
-using BlockPtr = std::unique_ptr<Block>;
+using BlockPtr = const Block *;
 
 class IfStmt : public Stmt {
 public:
   IfStmt(ExprPtr condition, StmtPtr thenStmt, StmtPtr elseStmt)
-      : condition(std::move(condition)), thenStmt(std::move(thenStmt)),
-        elseStmt(std::move(elseStmt)) {}
+      : condition(condition), thenStmt(thenStmt), elseStmt(elseStmt) {}
   StmtVisitorResT accept(StmtVisitor &visitor) const override;
 
   const ExprPtr condition;
@@ -71,19 +80,23 @@ public:
   const StmtPtr elseStmt;
 };
 
-using IfStmtPtr = std::unique_ptr<IfStmt>;
+using IfStmtPtr = const IfStmt *;
 
 class WhileStmt : public Stmt {
 public:
   WhileStmt(ExprPtr condition, StmtPtr stmt)
-      : condition(std::move(condition)), stmt(std::move(stmt)) {}
+      : condition(condition), stmt(stmt) {}
   StmtVisitorResT accept(StmtVisitor &visitor) const override;
 
   const ExprPtr condition;
   const StmtPtr stmt;
 };
 
-using WhileStmtPtr = std::unique_ptr<WhileStmt>;
+using WhileStmtPtr = const WhileStmt *;
+
+// What kind of function a FunStmt declares. Methods and initializers
+// take their receiver, "this", in slot 0 of their stack frame.
+enum class FunctionType { NONE, FUNCTION, METHOD, INIT };
 
 class FunStmt : public Stmt {
 public:
@@ -95,35 +108,50 @@ public:
   const Token name;
   const std::vector<Token> params;
   const std::vector<StmtPtr> body;
+  mutable Binding binding;
+  // Filled in by the Resolver: the stack slots a call needs, and whether
+  // closures capture any variable of the function's own scope. The
+  // captured ones among "this" and the parameters are listed by slot so
+  // the call can copy them into its Environment.
+  mutable int frameSize = 0;
+  mutable bool needsEnvironment = false;
+  mutable std::vector<int> capturedParams;
+  // Set by the Resolver when every call with the same arguments returns
+  // the same result and has no other effect, so calls may be memoized.
+  mutable bool pure = false;
 };
 
-using FunStmtPtr = std::unique_ptr<FunStmt>;
+using FunStmtPtr = const FunStmt *;
 
 class ReturnStmt : public Stmt {
 public:
   ReturnStmt(const Token &keyword, ExprPtr value)
-      : keyword(keyword), value(std::move(value)) {}
+      : keyword(keyword), value(value) {}
   StmtVisitorResT accept(StmtVisitor &visitor) const override;
 
   const Token keyword;
   const ExprPtr value;
+  // Set by the Resolver when value is a call the function can hand to
+  // its caller instead of making it itself (see TailCall).
+  mutable bool tailCall = false;
 };
 
-using ReturnStmtPtr = std::unique_ptr<ReturnStmt>;
+using ReturnStmtPtr = const ReturnStmt *;
 
 class ClassStmt : public Stmt {
 public:
   ClassStmt(const Token &name, VariablePtr super,
             std::vector<FunStmtPtr> methods)
-      : name(name), super(std::move(super)), methods(std::move(methods)) {}
+      : name(name), super(super), methods(std::move(methods)) {}
   StmtVisitorResT accept(StmtVisitor &visitor) const override;
 
   const Token name;
   const VariablePtr super;
   const std::vector<FunStmtPtr> methods;
+  mutable Binding binding;
 };
 
-using ClassStmtPtr = std::unique_ptr<ClassStmt>;
+using ClassStmtPtr = const ClassStmt *;
 
 class StmtVisitor {
 public:
@@ -1,5 +1,5 @@
 #include "token.h"
-#include "../utils/any_util.h"
+#include "../utils/value_util.h"
 #include <sstream>
 #include <unordered_map>
 
@@ -49,7 +49,7 @@ std::string Token::str() const {
   std::stringstream s;
   s << "Token type: " << tokenNames.at(type) << ", lexeme: " << lexeme
     << ", literal: ";
-  s << anyToStr(literal);
+  s << valueToStr(literal);
   return s.str();
 }
 
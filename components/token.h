@@ -1,9 +1,13 @@
 #pragma once
 
-#include <any>
+#include "loxstring.h"
+#include "value.h"
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
-enum class TokenType {
+enum class TokenType : uint8_t {
   // Single-character tokens.
   LEFT_PAREN,
   RIGHT_PAREN,
@@ -53,15 +57,21 @@ enum class TokenType {
   EOF_
 };
 
-class Token {
-public:
-  Token(TokenType type, const std::string &lexeme, const std::any &literal,
-        int line)
-      : type(type), lexeme(lexeme), literal(literal), line(line) {}
+// Tokens are plain data, copied into the AST nodes, so they stay small:
+// the lexeme views the Program's source text instead of owning a copy,
+// and one Value holds whatever the scanner computed for the token.
+struct Token {
+  std::string_view lexeme;
+  // NUMBER and STRING: the literal's value; IDENTIFIER, THIS and SUPER:
+  // the interned lexeme; nil otherwise
+  Value literal;
+  int line;
+  TokenType type;
+
+  // only for IDENTIFIER, THIS and SUPER
+  LoxString *symbol() const { return literal.as<LoxString>(); }
   std::string str() const;
   std::string errorStr() const;
-  const TokenType type;
-  const std::string lexeme;
-  const std::any literal;
-  const int line;
 };
+
+static_assert(std::is_trivially_copyable_v<Token>);
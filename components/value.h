@@ -0,0 +1,81 @@
+#pragma once
+
+#include "object.h"
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * A Lox value packed into 8 bytes using NaN-boxing.
+ *
+ * Any bit pattern that is not a quiet NaN with our tag bits set is a
+ * double. Nil, false, true and the internal "undefined" marker are small
+ * tags inside the quiet NaN space, and object pointers are stored in the
+ * low 48 bits with the sign bit set. Values do not own the objects they
+ * refer to; the garbage collector keeps reachable objects alive.
+ **/
+class Value {
+public:
+  Value() : bits_(QNAN | TAG_NIL) {}
+  Value(double num) { std::memcpy(&bits_, &num, sizeof(double)); }
+  Value(bool b) : bits_(b ? TRUE_BITS : FALSE_BITS) {}
+  Value(Object *obj)
+      : bits_(SIGN_BIT | QNAN | reinterpret_cast<uintptr_t>(obj)) {}
+
+  // Never visible to Lox code: marks a global slot that has been
+  // referenced but not defined yet.
+  static Value undefined() {
+    Value v;
+    v.bits_ = QNAN | TAG_UNDEFINED;
+    return v;
+  }
+
+  bool isNil() const { return bits_ == (QNAN | TAG_NIL); }
+  bool isUndefined() const { return bits_ == (QNAN | TAG_UNDEFINED); }
+  bool isBool() const { return (bits_ | 1) == TRUE_BITS; }
+  bool isNumber() const { return (bits_ & QNAN) != QNAN; }
+  bool isObj() const { return (bits_ & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT); }
+  bool isObjType(ObjType type) const {
+    return isObj() && asObj()->type == type;
+  }
+  bool isString() const { return isObjType(ObjType::STRING); }
+  bool isFunction() const { return isObjType(ObjType::FUNCTION); }
+  bool isClass() const { return isObjType(ObjType::CLASS); }
+  bool isInstance() const { return isObjType(ObjType::INSTANCE); }
+  bool isCallable() const {
+    return isObj() && (asObj()->type == ObjType::FUNCTION ||
+                       asObj()->type == ObjType::CLASS ||
+                       asObj()->type == ObjType::NATIVE);
+  }
+
+  bool asBool() const { return bits_ == TRUE_BITS; }
+  double asNumber() const {
+    double num;
+    std::memcpy(&num, &bits_, sizeof(double));
+    return num;
+  }
+  Object *asObj() const {
+    return reinterpret_cast<Object *>(
+        static_cast<uintptr_t>(bits_ & ~(SIGN_BIT | QNAN)));
+  }
+  // Caller is responsible for checking the object type first.
+  template <typename T> T *as() const { return static_cast<T *>(asObj()); }
+
+  bool sameBits(const Value &other) const { return bits_ == other.bits_; }
+
+private:
+  static constexpr uint64_t SIGN_BIT = 0x8000000000000000;
+  static constexpr uint64_t QNAN = 0x7ffc000000000000;
+  static constexpr uint64_t TAG_NIL = 1;
+  static constexpr uint64_t TAG_FALSE = 2;
+  static constexpr uint64_t TAG_TRUE = 3;
+  static constexpr uint64_t TAG_UNDEFINED = 4;
+  static constexpr uint64_t FALSE_BITS = QNAN | TAG_FALSE;
+  static constexpr uint64_t TRUE_BITS = QNAN | TAG_TRUE;
+
+  uint64_t bits_;
+};
+
+static_assert(sizeof(Value) == 8, "Value must stay NaN-boxed in 8 bytes");
+static_assert(std::is_trivially_copyable_v<Value>,
+              "Values are copied around freely by the GC and the VM");
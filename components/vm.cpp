@@ -0,0 +1,574 @@
+#include "vm.h"
+#include "../utils/value_util.h"
+#include "compiler.h"
+#include "interpreter.h"
+#include "loxstring.h"
+#include "native.h"
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+namespace {
+// Deeper than the tree-walker gets before its native stack runs out, so
+// only runaway recursion overflows.
+const size_t FRAMES_MAX = 1 << 16;
+// Slots a frame may use above its base: its locals and temporaries, and
+// the callee and arguments of the next call. The stack grows on a call
+// that could go past the end.
+const size_t FRAME_SLOTS = 2 * 256;
+const size_t INITIAL_STACK = 64 * FRAME_SLOTS;
+// Back from the end of an INVOKE-family instruction to its opcode, which
+// is marked with the method name; the last byte has the closing paren.
+const int INVOKE_NAME = 4;
+
+bool isFalsey(const Value &value) {
+  return value.isNil() || (value.isBool() && !value.asBool());
+}
+} // namespace
+
+VM::VM(ErrorReporter &errorReporter)
+    : errorReporter_(errorReporter), stack_(new Value[INITIAL_STACK]),
+      stackCapacity_(INITIAL_STACK), stackTop_(stack_.get()), frames_(),
+      openUpvalues_(nullptr), initString_(intern("init")) {
+  gc().addRoots(this);
+  defineNatives(globals_);
+}
+
+VM::~VM() { gc().removeRoots(this); }
+
+void VM::markRoots(GC &gc) {
+  for (const Value *slot = stack_.get(); slot < stackTop_; slot++) {
+    gc.mark(*slot);
+  }
+  for (const CallFrame &frame : frames_) {
+    gc.mark(frame.closure);
+  }
+  for (VmUpvalue *upvalue = openUpvalues_; upvalue != nullptr;
+       upvalue = upvalue->next) {
+    gc.mark(upvalue);
+  }
+  globals_.trace(gc);
+}
+
+void VM::interpret(const std::vector<StmtPtr> &stmts) {
+  VmClosure *closure;
+  {
+    // nothing roots the functions being compiled until the script's
+    // closure is on the stack
+    GCPause pause;
+    Compiler compiler(errorReporter_);
+    VmFunctionPtr script = compiler.compile(stmts);
+    if (script == nullptr) {
+      return;
+    }
+    closure = makeObj<VmClosure>(script);
+    push(closure);
+  }
+  try {
+    call(closure, 0);
+    run();
+  } catch (const RuntimeError &e) {
+    errorReporter_.reportRuntimeError(e);
+    resetStack();
+  }
+}
+
+void VM::run() {
+  CallFrame *frame = &frames_.back();
+  const uint8_t *ip = frame->ip;
+
+  auto readByte = [&]() { return *ip++; };
+  auto readShort = [&]() {
+    ip += 2;
+    return static_cast<int>((ip[-2] << 8) | ip[-1]);
+  };
+  auto readConstant = [&]() -> const Value & {
+    return frame->closure->function->chunk.constants[readShort()];
+  };
+  auto readString = [&]() { return readConstant().as<LoxString>(); };
+  auto readProperty = [&]() -> Chunk::PropertySite & {
+    return frame->closure->function->chunk.properties[readShort()];
+  };
+  // the frame's ip must be current before anything that can throw or
+  // push a new frame
+  auto saveIp = [&]() { frame->ip = ip; };
+  auto loadFrame = [&]() {
+    frame = &frames_.back();
+    ip = frame->ip;
+  };
+  auto checkOperands = [&]() {
+    if (!peek(0).isNumber() || !peek(1).isNumber()) {
+      saveIp();
+      checkNumbers(token(1), peek(1), peek(0));
+    }
+  };
+
+  while (true) {
+    switch (static_cast<OpCode>(readByte())) {
+    case OpCode::CONSTANT:
+      push(readConstant());
+      break;
+    case OpCode::NIL:
+      push(Value());
+      break;
+    case OpCode::TRUE:
+      push(true);
+      break;
+    case OpCode::FALSE:
+      push(false);
+      break;
+    case OpCode::POP:
+      pop();
+      break;
+    case OpCode::GET_LOCAL:
+      push(frame->slots[readByte()]);
+      break;
+    case OpCode::SET_LOCAL:
+      frame->slots[readByte()] = peek(0);
+      break;
+    case OpCode::GET_GLOBAL: {
+      int slot = readShort();
+      const Value &value = globals_.at(slot);
+      if (value.isUndefined()) {
+        saveIp();
+        GlobalTable::undefinedVariable(token(3));
+      }
+      push(value);
+      break;
+    }
+    case OpCode::DEFINE_GLOBAL:
+      globals_.at(readShort()) = pop();
+      break;
+    case OpCode::SET_GLOBAL: {
+      int slot = readShort();
+      Value &value = globals_.at(slot);
+      if (value.isUndefined()) {
+        saveIp();
+        GlobalTable::undefinedVariable(token(3));
+      }
+      value = peek(0);
+      break;
+    }
+    case OpCode::GET_UPVALUE:
+      push(*frame->closure->upvalues[readByte()]->location);
+      break;
+    case OpCode::SET_UPVALUE:
+      *frame->closure->upvalues[readByte()]->location = peek(0);
+      break;
+    case OpCode::GET_PROPERTY: {
+      Chunk::PropertySite &site = readProperty();
+      if (!peek(0).isObjType(ObjType::VM_INSTANCE)) {
+        saveIp();
+        notAnInstance(token(3));
+      }
+      auto *instance = peek(0).as<VmInstance>();
+      int slot = instance->findField(site.name, site.cache);
+      if (slot >= 0) {
+        peek(0) = instance->fields[slot];
+        break;
+      }
+      if (!bindMethod(instance->klass, site.name)) {
+        saveIp();
+        undefinedProperty(token(3));
+      }
+      break;
+    }
+    case OpCode::SET_PROPERTY: {
+      Chunk::PropertySite &site = readProperty();
+      if (!peek(1).isObjType(ObjType::VM_INSTANCE)) {
+        saveIp();
+        notAnInstance(token(3));
+      }
+      peek(1).as<VmInstance>()->setField(site.name, peek(0), site.cache);
+      // leave nil as the value of the assignment, like the tree-walker
+      popN(2);
+      push(Value());
+      break;
+    }
+    case OpCode::GET_SUPER: {
+      const LoxString *name = readString();
+      Value superclass = pop();
+      if (!bindMethod(superclass.as<VmClass>(), name)) {
+        saveIp();
+        undefinedSuperMethod(token(3));
+      }
+      break;
+    }
+    case OpCode::EQUAL: {
+      bool equal = valueEqual(peek(1), peek(0));
+      popN(2);
+      push(equal);
+      break;
+    }
+    case OpCode::NOT_EQUAL: {
+      bool equal = valueEqual(peek(1), peek(0));
+      popN(2);
+      push(!equal);
+      break;
+    }
+    case OpCode::GREATER:
+      checkOperands();
+      peek(1) = peek(1).asNumber() > peek(0).asNumber();
+      stackTop_--;
+      break;
+    case OpCode::GREATER_EQUAL:
+      checkOperands();
+      peek(1) = peek(1).asNumber() >= peek(0).asNumber();
+      stackTop_--;
+      break;
+    case OpCode::LESS:
+      checkOperands();
+      peek(1) = peek(1).asNumber() < peek(0).asNumber();
+      stackTop_--;
+      break;
+    case OpCode::LESS_EQUAL:
+      checkOperands();
+      peek(1) = peek(1).asNumber() <= peek(0).asNumber();
+      stackTop_--;
+      break;
+    case OpCode::ADD: {
+      if (peek(0).isNumber() && peek(1).isNumber()) {
+        peek(1) = peek(1).asNumber() + peek(0).asNumber();
+        stackTop_--;
+      } else if (peek(0).isString() && peek(1).isString()) {
+        StringPtr result = concatenate(peek(1).as<LoxString>(),
+                                       peek(0).as<LoxString>());
+        popN(2);
+        push(result);
+      } else {
+        saveIp();
+        cannotAdd(token(1));
+      }
+      break;
+    }
+    case OpCode::SUBTRACT:
+      checkOperands();
+      peek(1) = peek(1).asNumber() - peek(0).asNumber();
+      stackTop_--;
+      break;
+    case OpCode::MULTIPLY:
+      checkOperands();
+      peek(1) = peek(1).asNumber() * peek(0).asNumber();
+      stackTop_--;
+      break;
+    case OpCode::DIVIDE:
+      checkOperands();
+      peek(1) = peek(1).asNumber() / peek(0).asNumber();
+      stackTop_--;
+      break;
+    case OpCode::NOT:
+      peek(0) = isFalsey(peek(0));
+      break;
+    case OpCode::NEGATE:
+      if (!peek(0).isNumber()) {
+        saveIp();
+        checkNumber(token(1), peek(0));
+      }
+      peek(0) = -peek(0).asNumber();
+      break;
+    case OpCode::PRINT:
+      std::cout << valueToStr(pop()) << std::endl;
+      break;
+    case OpCode::JUMP: {
+      int offset = readShort();
+      ip += offset;
+      break;
+    }
+    case OpCode::JUMP_IF_FALSE: {
+      int offset = readShort();
+      if (isFalsey(peek(0)))
+        ip += offset;
+      break;
+    }
+    case OpCode::LOOP: {
+      int offset = readShort();
+      ip -= offset;
+      break;
+    }
+    case OpCode::CALL: {
+      int argCount = readByte();
+      saveIp();
+      callValue(peek(argCount), argCount);
+      loadFrame();
+      break;
+    }
+    case OpCode::INVOKE: {
+      Chunk::PropertySite &site = readProperty();
+      int argCount = readByte();
+      saveIp();
+      invoke(site, argCount);
+      loadFrame();
+      break;
+    }
+    case OpCode::SUPER_INVOKE: {
+      const LoxString *name = readString();
+      int argCount = readByte();
+      Value superclass = pop();
+      saveIp();
+      if (!invokeFromClass(superclass.as<VmClass>(), name, argCount)) {
+        undefinedSuperMethod(token(INVOKE_NAME));
+      }
+      loadFrame();
+      break;
+    }
+    case OpCode::TAIL_CALL: {
+      int argCount = readByte();
+      saveIp();
+      size_t frameCount = frames_.size();
+      callValue(peek(argCount), argCount);
+      replaceCaller(frameCount);
+      loadFrame();
+      break;
+    }
+    case OpCode::TAIL_INVOKE: {
+      Chunk::PropertySite &site = readProperty();
+      int argCount = readByte();
+      saveIp();
+      size_t frameCount = frames_.size();
+      invoke(site, argCount);
+      replaceCaller(frameCount);
+      loadFrame();
+      break;
+    }
+    case OpCode::TAIL_SUPER_INVOKE: {
+      const LoxString *name = readString();
+      int argCount = readByte();
+      Value superclass = pop();
+      saveIp();
+      size_t frameCount = frames_.size();
+      if (!invokeFromClass(superclass.as<VmClass>(), name, argCount)) {
+        undefinedSuperMethod(token(INVOKE_NAME));
+      }
+      replaceCaller(frameCount);
+      loadFrame();
+      break;
+    }
+    case OpCode::CLOSURE: {
+      auto function = readConstant().as<VmFunction>();
+      auto closure = makeObj<VmClosure>(function);
+      // on the stack before capturing, which may allocate
+      push(closure);
+      for (auto &upvalue : closure->upvalues) {
+        bool isLocal = readByte() == 1;
+        int index = readByte();
+        if (isLocal) {
+          upvalue = captureUpvalue(frame->slots + index);
+        } else {
+          upvalue = frame->closure->upvalues[index];
+        }
+      }
+      break;
+    }
+    case OpCode::CLOSE_UPVALUE:
+      closeUpvalues(stackTop_ - 1);
+      pop();
+      break;
+    case OpCode::RETURN: {
+      Value result = pop();
+      closeUpvalues(frame->slots);
+      Value *slots = frame->slots;
+      frames_.pop_back();
+      popN(stackTop_ - slots);
+      if (frames_.empty()) {
+        return;
+      }
+      push(result);
+      loadFrame();
+      break;
+    }
+    case OpCode::CLASS:
+      push(makeObj<VmClass>(std::string(readString()->chars())));
+      break;
+    case OpCode::INHERIT: {
+      if (!peek(1).isObjType(ObjType::VM_CLASS)) {
+        saveIp();
+        notASuperclass(token(1));
+      }
+      auto *superclass = peek(1).as<VmClass>();
+      auto *subclass = peek(0).as<VmClass>();
+      subclass->methods = superclass->methods;
+      pop();
+      break;
+    }
+    case OpCode::METHOD: {
+      const LoxString *name = readString();
+      auto *klass = peek(1).as<VmClass>();
+      klass->methods[name] = peek(0).as<VmClosure>();
+      pop();
+      break;
+    }
+    }
+  }
+}
+
+void VM::callValue(const Value &callee, int argCount) {
+  if (callee.isObj()) {
+    switch (callee.asObj()->type) {
+    case ObjType::VM_BOUND_METHOD: {
+      // the frame roots the method once the bound method's slot is
+      // overwritten
+      auto *bound = callee.as<VmBoundMethod>();
+      VmClosurePtr method = bound->method;
+      peek(argCount) = bound->receiver;
+      call(method, argCount);
+      return;
+    }
+    case ObjType::VM_CLASS: {
+      VmClassPtr klass = callee.as<VmClass>();
+      peek(argCount) = makeObj<VmInstance>(klass);
+      auto initializer = klass->methods.find(initString_);
+      if (initializer != klass->methods.end()) {
+        call(initializer->second, argCount);
+      } else if (argCount != 0) {
+        checkArity(token(1), 0, argCount);
+      }
+      return;
+    }
+    case ObjType::VM_CLOSURE:
+      call(callee.as<VmClosure>(), argCount);
+      return;
+    case ObjType::NATIVE: {
+      auto *native = callee.as<LoxNative>();
+      if (argCount != native->arity()) {
+        checkArity(token(1), native->arity(), argCount);
+      }
+      Value result = native->invoke(Args(stackTop_ - argCount, argCount));
+      popN(argCount + 1);
+      push(result);
+      return;
+    }
+    default:
+      break;
+    }
+  }
+  notCallable(token(1));
+}
+
+void VM::call(VmClosure *closure, int argCount) {
+  if (argCount != closure->function->arity) {
+    checkArity(token(1), closure->function->arity, argCount);
+  }
+  if (frames_.size() == FRAMES_MAX) {
+    stackOverflow();
+  }
+  if (stackCapacity_ - (stackTop_ - stack_.get()) < FRAME_SLOTS) {
+    growStack();
+  }
+  frames_.push_back(CallFrame{closure, closure->function->chunk.code.data(),
+                              stackTop_ - argCount - 1});
+}
+
+void VM::growStack() {
+  size_t capacity = stackCapacity_ * 2;
+  std::unique_ptr<Value[]> stack(new Value[capacity]);
+  std::copy(stack_.get(), stackTop_, stack.get());
+  // move everything pointing into the old stack over to the new one
+  auto rebase = [&](Value *slot) {
+    return stack.get() + (slot - stack_.get());
+  };
+  stackTop_ = rebase(stackTop_);
+  for (CallFrame &frame : frames_) {
+    frame.slots = rebase(frame.slots);
+  }
+  for (VmUpvalue *upvalue = openUpvalues_; upvalue != nullptr;
+       upvalue = upvalue->next) {
+    upvalue->location = rebase(upvalue->location);
+  }
+  stack_ = std::move(stack);
+  stackCapacity_ = capacity;
+}
+
+void VM::replaceCaller(size_t frameCount) {
+  if (frames_.size() == frameCount) {
+    // a native or a class without initializer; its result is on the stack
+    return;
+  }
+  CallFrame &caller = frames_[frames_.size() - 2];
+  CallFrame &callee = frames_.back();
+  // the caller's locals die here, as if it had returned
+  closeUpvalues(caller.slots);
+  Value *top = std::copy(callee.slots, stackTop_, caller.slots);
+  popN(stackTop_ - top);
+  callee.slots = caller.slots;
+  caller = callee;
+  frames_.pop_back();
+}
+
+void VM::invoke(Chunk::PropertySite &site, int argCount) {
+  const Value &receiver = peek(argCount);
+  if (!receiver.isObjType(ObjType::VM_INSTANCE)) {
+    notAnInstance(token(INVOKE_NAME));
+  }
+  auto *instance = receiver.as<VmInstance>();
+  int slot = instance->findField(site.name, site.cache);
+  if (slot >= 0) {
+    Value callee = instance->fields[slot];
+    peek(argCount) = callee;
+    callValue(callee, argCount);
+    return;
+  }
+  if (!invokeFromClass(instance->klass, site.name, argCount)) {
+    undefinedProperty(token(INVOKE_NAME));
+  }
+}
+
+bool VM::invokeFromClass(VmClass *klass, const LoxString *name,
+                         int argCount) {
+  auto method = klass->methods.find(name);
+  if (method == klass->methods.end()) {
+    return false;
+  }
+  call(method->second, argCount);
+  return true;
+}
+
+bool VM::bindMethod(VmClass *klass, const LoxString *name) {
+  auto method = klass->methods.find(name);
+  if (method == klass->methods.end()) {
+    return false;
+  }
+  peek(0) = makeObj<VmBoundMethod>(peek(0), method->second);
+  return true;
+}
+
+VmUpvalue *VM::captureUpvalue(Value *local) {
+  VmUpvalue *prev = nullptr;
+  VmUpvalue *upvalue = openUpvalues_;
+  while (upvalue != nullptr && upvalue->location > local) {
+    prev = upvalue;
+    upvalue = upvalue->next;
+  }
+  if (upvalue != nullptr && upvalue->location == local) {
+    return upvalue;
+  }
+
+  auto *created = makeObj<VmUpvalue>(local);
+  created->next = upvalue;
+  if (prev == nullptr) {
+    openUpvalues_ = created;
+  } else {
+    prev->next = created;
+  }
+  return created;
+}
+
+void VM::closeUpvalues(Value *last) {
+  while (openUpvalues_ != nullptr && openUpvalues_->location >= last) {
+    VmUpvalue *upvalue = openUpvalues_;
+    upvalue->closed = *upvalue->location;
+    upvalue->location = &upvalue->closed;
+    openUpvalues_ = upvalue->next;
+  }
+}
+
+void VM::resetStack() {
+  closeUpvalues(stack_.get());
+  stackTop_ = stack_.get();
+  frames_.clear();
+}
+
+const Token &VM::token(int back) const {
+  const CallFrame &frame = frames_.back();
+  const Chunk &chunk = frame.closure->function->chunk;
+  return chunk.tokenAt(frame.ip - chunk.code.data() - back);
+}
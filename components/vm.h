@@ -0,0 +1,74 @@
+#pragma once
+
+#include "error.h"
+#include "gc.h"
+#include "globals.h"
+#include "loxstring.h"
+#include "stmt.h"
+#include "vmobject.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Stack-based bytecode virtual machine, an alternative execution engine
+ * to the tree-walking Interpreter.
+ *
+ * interpret() compiles a resolved program with the Compiler and runs it.
+ * Globals persist across calls, so the VM can back the REPL as well.
+ *
+ * Temporaries live on the VM stack, so the stack, the frames' closures,
+ * the open upvalues and the globals are all the GC needs as roots.
+ **/
+class VM : public RootSource {
+public:
+  explicit VM(ErrorReporter &errorReporter);
+  ~VM() override;
+  void interpret(const std::vector<StmtPtr> &stmts);
+  GlobalTable &globals() { return globals_; }
+  void markRoots(GC &gc) override;
+
+private:
+  struct CallFrame {
+    VmClosure *closure;
+    const uint8_t *ip;
+    // first stack slot of this frame; holds the callee or receiver
+    Value *slots;
+  };
+
+  void run();
+  void push(Value value) { *stackTop_++ = value; }
+  Value pop() { return *--stackTop_; }
+  Value &peek(int distance) { return stackTop_[-1 - distance]; }
+  void popN(int count) { stackTop_ -= count; }
+  void callValue(const Value &callee, int argCount);
+  // May grow the stack for the new frame, which moves it: references into
+  // the stack taken before the call are stale after it.
+  void call(VmClosure *closure, int argCount);
+  // Doubles the stack, updating the pointers into it.
+  void growStack();
+  void invoke(Chunk::PropertySite &site, int argCount);
+  // false, without calling anything, if klass has no such method
+  bool invokeFromClass(VmClass *klass, const LoxString *name, int argCount);
+  bool bindMethod(VmClass *klass, const LoxString *name);
+  // After a tail call: if it pushed a frame, that frame takes the place
+  // of its caller's, which was frameCount - 1.
+  void replaceCaller(size_t frameCount);
+  VmUpvalue *captureUpvalue(Value *local);
+  void closeUpvalues(Value *last);
+  void resetStack();
+  // What a runtime error in the running frame is reported against: the
+  // token marked for the byte `back` bytes before its saved ip.
+  const Token &token(int back) const;
+
+  ErrorReporter &errorReporter_;
+  GlobalTable globals_;
+  std::unique_ptr<Value[]> stack_;
+  size_t stackCapacity_;
+  Value *stackTop_;
+  std::vector<CallFrame> frames_;
+  // upvalues still pointing into the stack, highest slot first
+  VmUpvalue *openUpvalues_;
+  const LoxString *initString_;
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "chunk.h"
+#include "gc.h"
+#include "loxstring.h"
+#include "object.h"
+#include "shape.h"
+#include "value.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Heap objects of the bytecode VM. The tree-walker's LoxFunction and
+ * LoxClass hold on to AST nodes and environments, so the VM has its own
+ * compiled function, closure and class representations.
+ **/
+
+class VmFunction : public Object {
+public:
+  explicit VmFunction(const std::string &name)
+      : Object(ObjType::VM_FUNCTION), name(name) {}
+  std::string str() const override {
+    if (name.empty())
+      return "<script>";
+    return "<func name: " + name + ", arity: " + std::to_string(arity) + ">";
+  }
+  void trace(GC &gc) const override {
+    for (const Value &constant : chunk.constants) {
+      gc.mark(constant);
+    }
+  }
+
+  const std::string name;
+  int arity = 0;
+  int upvalueCount = 0;
+  Chunk chunk;
+};
+
+using VmFunctionPtr = VmFunction *;
+
+// A variable captured by a closure. While the variable is still on the VM
+// stack the upvalue points at it ("open"); when it goes out of scope the
+// value is moved into `closed` and `location` points there instead.
+class VmUpvalue : public Object {
+public:
+  explicit VmUpvalue(Value *slot)
+      : Object(ObjType::VM_UPVALUE), location(slot), closed(), next(nullptr) {}
+  std::string str() const override { return "upvalue"; }
+  // an open upvalue's variable is on the (rooted) stack
+  void trace(GC &gc) const override { gc.mark(closed); }
+
+  Value *location;
+  Value closed;
+  // next open upvalue, ordered by stack slot (highest first)
+  VmUpvalue *next;
+};
+
+using VmUpvaluePtr = VmUpvalue *;
+
+class VmClosure : public Object {
+public:
+  explicit VmClosure(VmFunctionPtr function)
+      : Object(ObjType::VM_CLOSURE), function(function),
+        upvalues(function->upvalueCount) {}
+  std::string str() const override { return function->str(); }
+  void trace(GC &gc) const override {
+    gc.mark(function);
+    for (VmUpvalue *upvalue : upvalues) {
+      gc.mark(upvalue);
+    }
+  }
+
+  const VmFunctionPtr function;
+  std::vector<VmUpvaluePtr> upvalues;
+};
+
+using VmClosurePtr = VmClosure *;
+
+class VmClass : public Object {
+public:
+  explicit VmClass(const std::string &name)
+      : Object(ObjType::VM_CLASS), name(name), rootShape(this) {}
+  std::string str() const override { return name; }
+  void trace(GC &gc) const override {
+    for (const auto &[name, method] : methods) {
+      gc.mark(method);
+    }
+  }
+
+  const std::string name;
+  // methods are copied down from the superclass on inheritance
+  SymbolMap<VmClosurePtr> methods;
+  // shape new instances start with
+  Shape rootShape;
+};
+
+using VmClassPtr = VmClass *;
+
+// Fields are laid out by shapes like LoxInstance's, and the property
+// instructions have inline caches of their own (see Chunk::PropertySite).
+class VmInstance : public Object {
+public:
+  explicit VmInstance(VmClassPtr klass)
+      : Object(ObjType::VM_INSTANCE), klass(klass), shape(&klass->rootShape) {}
+  std::string str() const override { return klass->name + " instance"; }
+  void trace(GC &gc) const override {
+    gc.mark(klass);
+    for (const Value &value : fields) {
+      gc.mark(value);
+    }
+  }
+
+  // slot of the field `name`, or -1 if there is none
+  int findField(const LoxString *name, PropertyCache &cache) {
+    if (const PropertyCache::Entry *entry = cache.find(shape)) {
+      return entry->slot;
+    }
+    int slot = shape->lookup(name);
+    cache.add({shape->id(), slot, nullptr, nullptr});
+    return slot;
+  }
+  void setField(const LoxString *name, const Value &value,
+                PropertyCache &cache) {
+    if (const PropertyCache::Entry *entry = cache.find(shape)) {
+      if (entry->next == nullptr) {
+        fields[entry->slot] = value;
+      } else {
+        addField(entry->next, value);
+      }
+      return;
+    }
+    int slot = shape->lookup(name);
+    if (slot >= 0) {
+      cache.add({shape->id(), slot, nullptr, nullptr});
+      fields[slot] = value;
+      return;
+    }
+    Shape *next = shape->transition(name);
+    cache.add({shape->id(), static_cast<int>(fields.size()), nullptr, next});
+    addField(next, value);
+  }
+  // as LoxInstance::addField
+  void addField(Shape *next, const Value &value) {
+    size_t capacity = fields.capacity();
+    if (capacity == 0) {
+      fields.reserve(shape->expectedFields());
+    }
+    shape = next;
+    fields.push_back(value);
+    gc().charge(this, (fields.capacity() - capacity) * sizeof(Value));
+  }
+
+  const VmClassPtr klass;
+  // layout of fields; owned by klass's shape tree
+  Shape *shape;
+  std::vector<Value> fields;
+};
+
+class VmBoundMethod : public Object {
+public:
+  VmBoundMethod(Value receiver, VmClosurePtr method)
+      : Object(ObjType::VM_BOUND_METHOD), receiver(receiver), method(method) {}
+  std::string str() const override { return method->str(); }
+  void trace(GC &gc) const override {
+    gc.mark(receiver);
+    gc.mark(method);
+  }
+
+  const Value receiver;
+  const VmClosurePtr method;
+};
@@ -1,61 +1,94 @@
+#include "components/closurecompiler.h"
 #include "components/error.h"
 #include "components/expr.h"
+#include "components/gc.h"
 #include "components/interpreter.h"
+#include "components/memo.h"
+#include "components/optimizer.h"
 #include "components/parser.h"
+#include "components/program.h"
 #include "components/resolver.h"
 #include "components/scanner.h"
 #include "components/stmt.h"
+#include "components/vm.h"
 #include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <memory>
-#include <sstream>
+#include <system_error>
 
 namespace {
+// The tree-walking Interpreter is the reference implementation; the
+// closure compiler and the bytecode VM are selected with --engine.
+enum class Engine { TREE, CLOSURE, VM };
+
 static BasicErrorReporter ERROR_REPORTER;
 Interpreter ip(ERROR_REPORTER);
+ClosureCompiler closureCompiler(ip, ERROR_REPORTER);
+VM vm(ERROR_REPORTER);
+Engine engine = Engine::TREE;
+bool optimize = false;
 
-// HACK
-// We need to keep the statements parsed in the REPL because
-// some of the statements (e.g. functions, classes) would be
-// needed later. We can't have them destroyed when "run"
-// returns.
-// If we don't track, nasty bugs happen (we keep a reference to
-// stmts in functions now).
-static auto stmtTracker = std::make_unique<std::vector<StmtPtr>>();
-
-void run(const std::string &source, bool trackStmt) {
-  Scanner scanner(source, ERROR_REPORTER);
-  auto tokens = scanner.scanTokens();
-  Parser parser(tokens, ERROR_REPORTER);
+// Parses and executes one unit of source. The returned Program owns the
+// source and the AST; functions and classes the tree-walker and the
+// closure compiler create refer to its nodes, and VM code to its tokens,
+// so it must outlive them.
+std::unique_ptr<Program> run(std::string source) {
+  auto program = std::make_unique<Program>(std::move(source));
+  Scanner scanner(program->source, ERROR_REPORTER);
+  const auto &tokens = scanner.scanTokens();
+  Parser parser(tokens, program->arena, ERROR_REPORTER);
 
-  auto stmts = parser.parse();
+  program->stmts = parser.parse();
+  const std::vector<StmtPtr> &stmts = program->stmts;
 
   if (ERROR_REPORTER.hadError()) {
-    return;
+    return program;
   }
 
-  Resolver resolver(ip, ERROR_REPORTER);
+  GlobalTable &globals = engine == Engine::VM ? vm.globals() : ip.globals();
+  Resolver resolver(globals, ERROR_REPORTER);
   resolver.resolve(stmts);
 
   if (ERROR_REPORTER.hadError()) {
-    return;
+    return program;
   }
 
-  ip.interpret(stmts);
+  if (optimize) {
+    Optimizer optimizer(program->arena);
+    program->stmts = optimizer.optimize(stmts);
+  }
 
-  if (trackStmt) {
-    for (auto &&stmt : stmts) {
-      stmtTracker->push_back(std::move(stmt));
-    }
+  if (engine == Engine::VM) {
+    vm.interpret(stmts);
+  } else if (engine == Engine::CLOSURE) {
+    closureCompiler.interpret(stmts, resolver.scriptFrameSize());
+  } else {
+    ip.interpret(stmts, resolver.scriptFrameSize());
   }
+  return program;
 }
 
 void runFile(const std::string &path) {
-  std::ifstream t(path);
-  std::stringstream buffer;
-  buffer << t.rdbuf();
-  run(buffer.str(), false);
+  // read straight into the string the Program takes over
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  std::string source;
+  // a directory opens too, and seeking to its end gives a bogus size
+  std::error_code ec;
+  bool directory = std::filesystem::is_directory(path, ec);
+  std::streampos size =
+      file && !directory ? file.tellg() : std::streampos(-1);
+  if (size != std::streampos(-1)) {
+    source.resize(size);
+    file.seekg(0);
+    file.read(source.data(), source.size());
+  }
+  if (size == std::streampos(-1) || !file) {
+    std::cerr << "Could not read file \"" << path << "\"." << std::endl;
+    exit(74);
+  }
+  auto program = run(std::move(source));
   if (ERROR_REPORTER.hadError()) {
     exit(65);
   }
@@ -64,31 +97,93 @@ void runFile(const std::string &path) {
   }
 }
 
+void printGCStats() {
+  const GCStats &stats = gc().stats();
+  std::cerr << "[gc] collections: " << stats.collections
+            << ", pause: " << stats.pauseSeconds * 1000 << " ms\n"
+            << "[gc] objects allocated: " << stats.objectsAllocated
+            << ", freed: " << stats.objectsFreed << "\n"
+            << "[gc] bytes allocated: " << stats.bytesAllocated
+            << ", freed: " << stats.bytesFreed
+            << ", live: " << stats.liveBytes << ", peak: " << stats.peakBytes
+            << std::endl;
+}
+
+void printMemoStats() {
+  const MemoStats &stats = memoStats();
+  std::cerr << "[memo] hits: " << stats.hits << ", misses: " << stats.misses
+            << std::endl;
+}
+
 void runPrompt() {
+  // functions and classes defined by one line may be called by a later one
+  std::vector<std::unique_ptr<Program>> session;
   while (true) {
     std::cout << "> ";
     std::string line;
     std::getline(std::cin, line);
-    try {
-      run(line, true);
-    } catch (std::invalid_argument *e) {
-      std::cout << "invalid_argument: " << e->what() << std::endl;
-    }
+    session.push_back(run(std::move(line)));
     ERROR_REPORTER.reset();
   }
 }
 } // namespace
 
 int main(int argc, char *argv[]) {
-  switch (argc) {
-  case 1:
+  std::vector<std::string> args;
+  GCConfig gcConfig;
+  bool gcStats = false;
+  bool memoStats = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.rfind("--gc-threshold=", 0) == 0) {
+      gcConfig.initialThreshold = std::stoul(arg.substr(15));
+    } else if (arg.rfind("--gc-growth=", 0) == 0) {
+      gcConfig.growthFactor = std::stod(arg.substr(12));
+    } else if (arg == "--gc-stress") {
+      gcConfig.stress = true;
+    } else if (arg == "--gc-stats") {
+      gcStats = true;
+    } else if (arg == "--optimize") {
+      optimize = true;
+    } else if (arg == "--memoize") {
+      memoConfig().enabled = true;
+    } else if (arg.rfind("--memo-size=", 0) == 0) {
+      memoConfig().maxEntries = std::stoul(arg.substr(12));
+    } else if (arg == "--memo-stats") {
+      memoStats = true;
+    } else if (arg == "--engine=tree") {
+      engine = Engine::TREE;
+    } else if (arg == "--engine=closure") {
+      engine = Engine::CLOSURE;
+    } else if (arg == "--engine=vm") {
+      engine = Engine::VM;
+    } else {
+      args.push_back(arg);
+    }
+  }
+
+  gc().configure(gcConfig);
+  if (gcStats) {
+    // runFile() leaves through exit()
+    std::atexit(printGCStats);
+  }
+  if (memoStats) {
+    std::atexit(printMemoStats);
+  }
+
+  switch (args.size()) {
+  case 0:
     runPrompt();
     break;
-  case 2:
-    runFile(argv[1]);
+  case 1:
+    runFile(args[0]);
     break;
   default:
-    std::cout << "Usage: lox [script]" << std::endl;
+    std::cout << "Usage: lox [--engine=tree|closure|vm] [--optimize] "
+                 "[--memoize] [--memo-size=entries] [--memo-stats] "
+                 "[--gc-threshold=bytes] [--gc-growth=factor] [--gc-stress] "
+                 "[--gc-stats] [script]"
+              << std::endl;
     return 64;
   }
   return 0;
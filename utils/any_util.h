@@ -1,6 +0,0 @@
-#include <any>
-#include <string>
-
-std::string anyToStr(const std::any &a);
-
-bool anyEqual(const std::any &a, const std::any &b);
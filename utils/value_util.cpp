@@ -0,0 +1,48 @@
+#include "value_util.h"
+#include "../components/loxstring.h"
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+std::string valueToStr(const Value &v) {
+  std::stringstream s;
+  if (v.isNil()) {
+    return "Nil";
+  } else if (v.isNumber()) {
+    s << v.asNumber();
+  } else if (v.isBool()) {
+    s << (v.asBool() ? "true" : "false");
+  } else if (v.isString()) {
+    s << v.as<LoxString>()->chars();
+  } else {
+    s << v.asObj()->str() << std::endl;
+  }
+  return s.str();
+}
+
+bool valueEqual(const Value &a, const Value &b) {
+  if (a.isNumber() && b.isNumber()) {
+    return std::fabs(a.asNumber() - b.asNumber()) <
+           std::numeric_limits<double>::epsilon();
+  }
+  if (a.isString() && b.isString()) {
+    const LoxString *x = a.as<LoxString>();
+    const LoxString *y = b.as<LoxString>();
+    if (x == y)
+      return true;
+    // distinct interned strings always differ
+    if (x->interned() && y->interned())
+      return false;
+    return x->length() == y->length() && x->chars() == y->chars();
+  }
+  // nil, booleans and all other objects compare by identity
+  return a.sameBits(b);
+}
+
+bool isTruthy(const Value &value) {
+  if (value.isNil())
+    return false;
+  if (value.isBool())
+    return value.asBool();
+  return true;
+}
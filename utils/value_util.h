@@ -0,0 +1,11 @@
+#pragma once
+
+#include "../components/value.h"
+#include <string>
+
+std::string valueToStr(const Value &v);
+
+bool valueEqual(const Value &a, const Value &b);
+
+// only nil and false are falsey
+bool isTruthy(const Value &value);